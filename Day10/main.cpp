@@ -1,7 +1,9 @@
 #include "aoc/helpers.h"
+#include <algorithm>
+#include <array>
+#include <vector>
 
 namespace {
-  using Result = std::pair<int, int>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
   constexpr std::string_view SampleInput(R"(addx 15
@@ -151,77 +153,222 @@ noop
 noop
 noop)");
   constexpr int SR_Part1 = 13140;
-  constexpr int SR_Part2 = 0;
+  // The sample image is a test pattern rather than letters
+  constexpr std::string_view SR_Part2("????????");
+  constexpr std::string_view SR_Screen(R"(##..##..##..##..##..##..##..##..##..##..
+###...###...###...###...###...###...###.
+####....####....####....####....####....
+#####.....#####.....#####.....#####.....
+######......######......######......####
+#######.......#######.......#######.....
+)");
+
+  constexpr int64_t ScreenWidth = 40;
+  constexpr int64_t ScreenHeight = 6;
+  constexpr int64_t FirstSample = 20;
+  constexpr int64_t GlyphWidth = 5;
+  constexpr int64_t GlyphHeight = 6;
+
+  // Letters of the CRT font, each drawn as 6 rows of 4 pixels
+  const std::vector<std::pair<char, std::string_view>> Glyphs{
+    { 'A', ".##.#..##..######..##..#" },
+    { 'B', "###.#..####.#..##..####." },
+    { 'C', ".##.#..##...#...#..#.##." },
+    { 'E', "#####...###.#...#...####" },
+    { 'F', "#####...###.#...#...#..." },
+    { 'G', ".##.#..##...#.###..#.###" },
+    { 'H', "#..##..######..##..##..#" },
+    { 'J', "..##...#...#...##..#.##." },
+    { 'K', "#..##.#.##..#.#.#.#.#..#" },
+    { 'L', "#...#...#...#...#...####" },
+    { 'O', ".##.#..##..##..##..#.##." },
+    { 'P', "###.#..##..####.#...#..." },
+    { 'R', "###.#..##..####.#.#.#..#" },
+    { 'S', ".####...#....##....####." },
+    { 'U', "#..##..##..##..##..#.##." },
+    { 'Z', "####...#..#..#..#...####" },
+  };
+
+  enum class OpCode : uint8_t {
+    Noop,
+    Addx,
+  };
+
+  struct Instruction {
+    OpCode op;
+    int32_t arg;
+  };
+
+  using Program = std::vector<Instruction>;
 
   class CPU {
     public:
       CPU()
-        : cycle_(0)
-        , running_sum_(0)
-        , reg_x_(1)
+        : running_sum_(0)
       {
+        screen_.fill('.');
       }
 
-      void addx(int64_t v) {
-        step();
-        step();
-        reg_x_ += v;
-      }
+      // Decoded program runs in a single loop.  The beam position and the next
+      // signal sample are tracked as counters so the loop needs no division.
+      void run(const Program& program) {
+        int64_t reg_x = 1;
+        int64_t cycle = 0;
+        int64_t next_sample = FirstSample;
+        int64_t pixel = 0;
+        int64_t column = 0;
+        int64_t sum = 0;
 
-      void noop() {
-        step();
+        const auto tick = [&]() {
+          screen_[pixel] = (column >= reg_x - 1 && column <= reg_x + 1) ? '#' : '.';
+          cycle++;
+          if (cycle == next_sample) {
+            sum += cycle * reg_x;
+            next_sample += ScreenWidth;
+          }
+          pixel++;
+          column++;
+          if (column == ScreenWidth) {
+            column = 0;
+            if (pixel == ScreenWidth * ScreenHeight) { pixel = 0; }
+          }
+        };
+
+        for (const auto& ins : program) {
+          switch (ins.op) {
+            case OpCode::Noop:
+              tick();
+              break;
+            case OpCode::Addx:
+              tick();
+              tick();
+              reg_x += ins.arg;
+              break;
+          }
+        }
+        running_sum_ += sum;
       }
 
       int64_t getRunningSum() const {
         return running_sum_;
       }
-    private:
-      void step() {
-        auto pos = cycle_;
-        while (pos > 40) { pos -= 40; }
-        if (pos >= (reg_x_ - 1) && pos <= (reg_x_ + 1)) {
-          std::cout << "#";
-        } else {
-          std::cout << ".";
+
+      std::string render() const {
+        std::string out;
+        out.reserve(screen_.size() + ScreenHeight);
+        for (int64_t y = 0; y < ScreenHeight; y++) {
+          out.append(&screen_[y * ScreenWidth], ScreenWidth);
+          out.push_back('\n');
         }
-        cycle_++;
-        if (!(cycle_ % 40)) {
-          std::cout << std::endl;
+        return out;
+      }
+
+      // Read the screen as letters, with '?' for any unrecognised glyph
+      std::string decode() const {
+        std::string out;
+        std::string glyph;
+        for (int64_t g = 0; g < ScreenWidth / GlyphWidth; g++) {
+          glyph.clear();
+          for (int64_t y = 0; y < GlyphHeight; y++) {
+            glyph.append(&screen_[y * ScreenWidth + g * GlyphWidth], GlyphWidth - 1);
+          }
+          const auto it = std::find_if(Glyphs.begin(), Glyphs.end(),
+            [&glyph](const auto& e) { return e.second == glyph; });
+          out.push_back(it == Glyphs.end() ? '?' : it->first);
         }
-        if (cycle_ < 20) { return; }
-        
-        const auto offset = cycle_ - 20;
-        if ((offset % 40)) { return; }
-        running_sum_ += (cycle_ * reg_x_);
+        return out;
       }
 
-      int64_t cycle_;
+    private:
       int64_t running_sum_;
-      int64_t reg_x_;
+      std::array<char, ScreenWidth * ScreenHeight> screen_;
+  };
+
+  // Answers "what is X during cycle c" without running the program.  The
+  // cycle each instruction finishes on and the value of X after it are
+  // prefix sums, so a query is a binary search over instruction end cycles.
+  class SignalSampler {
+    public:
+      SignalSampler(const Program& program)
+      {
+        end_cycle_.reserve(program.size());
+        reg_x_.reserve(program.size() + 1);
+        int64_t cycle = 0;
+        int64_t reg_x = 1;
+        reg_x_.push_back(reg_x);
+        for (const auto& ins : program) {
+          switch (ins.op) {
+            case OpCode::Noop:
+              cycle += 1;
+              break;
+            case OpCode::Addx:
+              cycle += 2;
+              reg_x += ins.arg;
+              break;
+          }
+          end_cycle_.push_back(cycle);
+          reg_x_.push_back(reg_x);
+        }
+      }
+
+      int64_t getCycles() const {
+        return end_cycle_.empty() ? 0 : end_cycle_.back();
+      }
+
+      // X during `cycle` (1-based) only reflects instructions which finished
+      // before that cycle began
+      int64_t registerAt(int64_t cycle) const {
+        const auto done = std::upper_bound(end_cycle_.begin(), end_cycle_.end(), cycle - 1);
+        return reg_x_[done - end_cycle_.begin()];
+      }
+
+      template<typename Cycles>
+      int64_t signalStrength(const Cycles& cycles) const {
+        int64_t sum = 0;
+        for (const auto c : cycles) {
+          sum += c * registerAt(c);
+        }
+        return sum;
+      }
+
+      // The puzzle's samples: every 40th cycle from the 20th to the end
+      std::vector<int64_t> periodicCycles() const {
+        std::vector<int64_t> cycles;
+        for (int64_t c = FirstSample; c <= getCycles(); c += ScreenWidth) {
+          cycles.push_back(c);
+        }
+        return cycles;
+      }
+
+    private:
+      std::vector<int64_t> end_cycle_;
+      std::vector<int64_t> reg_x_;
   };
 
   STRING_CONSTANT(ADDX, "addx");
   STRING_CONSTANT(NOOP, "noop");
 
-  const auto LoadInput = [](auto f) {
-    Result r{0, 0};
+  const auto Decode = [](auto f) {
+    Program program;
     std::string_view line;
-    CPU cpu;
     while (aoc::getline(f, line)) {
       const auto sep = line.find(' ');
       const auto inst = sep == std::string_view::npos ? line : line.substr(0, sep);
       if (inst == NOOP) {
-        cpu.noop();
+        program.push_back({ OpCode::Noop, 0 });
       } else if (inst == ADDX) {
         assert(sep != std::string_view::npos);
         const auto arg = line.substr(sep + 1);
-        cpu.addx(aoc::stoi(arg));
+        program.push_back({ OpCode::Addx, static_cast<int32_t>(aoc::stoi(arg)) });
       } else {
         throw std::runtime_error("Bad instruction: " + std::string(line));
       }
     }
-    r.first = cpu.getRunningSum();
-    return r;
+    return program;
+  };
+
+  const auto LoadInput = [](auto f) {
+    return Decode(f);
   };
 }
 
@@ -229,23 +376,42 @@ int main(int argc, char** argv) {
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
-  Result r;
+  Program program;
   if (inTest) {
-    r = LoadInput(SampleInput);
+    program = LoadInput(SampleInput);
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    program = LoadInput(f);
   }
 
-  int part1 = 0;
-  int part2 = 0;
+  // Sample the register at the cycles given after the input file
+  if (argc > 2) {
+    const SignalSampler sampler(program);
+    std::vector<int64_t> cycles;
+    for (int i = 2; i < argc; i++) {
+      cycles.push_back(aoc::stoi(argv[i]));
+      std::cout << "Cycle " << cycles.back() << ": X = " << sampler.registerAt(cycles.back()) << std::endl;
+    }
+    std::cout << "Signal strength: " << sampler.signalStrength(cycles) << std::endl;
+    return 0;
+  }
+
+  CPU cpu;
+  cpu.run(program);
+
+  const auto screen = cpu.render();
+  std::cout << screen;
 
-  std::tie(part1, part2) = r;
+  const int64_t part1 = cpu.getRunningSum();
+  const std::string part2 = cpu.decode();
 
   aoc::print_results(part1, part2);
 
   if (inTest) {
+    const SignalSampler sampler(program);
+    aoc::assert_result(sampler.signalStrength(sampler.periodicCycles()), SR_Part1);
+    aoc::assert_result(screen, SR_Screen);
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
   }
@@ -1,7 +1,10 @@
 #include "aoc/helpers.h"
-#include <queue>
-#include <list>
+#include "aoc/parallel.h"
 #include <iostream>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace {
   using Result = std::pair<int, int>;
@@ -37,12 +40,6 @@ Monkey 3:
   constexpr size_t SR_Part1 = 10605;
   constexpr size_t SR_Part2 = 2713310158;
 
-#ifndef NDEBUG
-  using ItemList = std::list<int64_t>;
-#else
-  using ItemList = std::queue<int64_t>;
-#endif
-
   enum class OpType {
     None = 0,
     Mul = '*',
@@ -61,99 +58,96 @@ Monkey 3:
     }
   };
 
-  class Monkey {
-  public:
-    Monkey()
-      : op_(OpType::None)
-      , arg_(0)
-      , test_(0)
-      , true_(0)
-      , false_(0)
-      , insepected_(0)
-    {
-    }
-
-    void takeTurn(std::vector<Monkey>& ms, int64_t mod) {
-      while (!items_.empty()) {
-        auto in = items_.front();
-#ifndef NDEBUG
-        items_.pop_front();
-#else
-        items_.pop();
-#endif
-        auto item = performOperation(in); // increase worry
-          // decrease worry
-        if (!mod) { item /= 3; }
-        else {item %= mod; }
-        const auto test = !(item % test_); // test
-        const auto dst = test ? true_ : false_;
-        DEBUG_LOG(in, (char)op_, arg_, item, test_, test, dst);
-        assert(dst < ms.size());
-        ms[dst].addItem(item); // throw
-        insepected_++;
-      }
+  using Operation = uint64_t (*)(uint64_t, uint64_t);
+
+  template<OpType Op>
+  uint64_t Apply(uint64_t item, uint64_t arg) {
+    if constexpr (Op == OpType::Add) {
+      return item + arg;
+    } else if constexpr (Op == OpType::Mul) {
+      return item * arg;
+    } else {
+      static_assert(Op == OpType::Pow);
+      return item * item;
     }
+  }
 
-    void addItem(int64_t i) {
-#ifndef NDEBUG
-      items_.push_back(i);
-#else
-      items_.push(i);
-#endif
+  const auto CompileOperation = [](OpType op) -> Operation {
+    switch (op) {
+      case OpType::Add:
+        return &Apply<OpType::Add>;
+      case OpType::Mul:
+        return &Apply<OpType::Mul>;
+      case OpType::Pow:
+        return &Apply<OpType::Pow>;
+      case OpType::None:
+        break;
     }
+    throw std::runtime_error("Bad optype");
+  };
 
-    void setOperation(OpType o) {
-      op_ = o;
-    }
+  // x % d by multiplying with a precomputed reciprocal instead of dividing.
+  // The estimated quotient is at most two short, so the remainder needs at
+  // most two corrections.
+  class Barrett {
+    public:
+      Barrett()
+        : d_(1)
+        , m_(0)
+      { }
+
+      Barrett(uint64_t d)
+        : d_(d)
+        , m_(UINT64_MAX / d)
+      { }
+
+      uint64_t reduce(uint64_t x) const {
+        const uint64_t q = (static_cast<unsigned __int128>(x) * m_) >> 64;
+        uint64_t r = x - q * d_;
+        r -= (r >= d_) ? d_ : 0;
+        r -= (r >= d_) ? d_ : 0;
+        return r;
+      }
 
-    void setArg(int64_t a) {
-      arg_ = a;
-    }
+      bool divides(uint64_t x) const {
+        return reduce(x) == 0;
+      }
 
-    void setTest(int64_t t) {
-      test_ = t;
-    }
+      uint64_t divisor() const {
+        return d_;
+      }
 
-    void setTrue(int64_t t) {
-      true_ = t;
-    }
+    private:
+      uint64_t d_;
+      uint64_t m_;
+  };
 
-    void setFalse(int64_t t) {
-      false_ = t;
+  // Monkeys as a structure of arrays.  Operations are compiled to a function
+  // pointer per monkey when the input is loaded, and every starting item
+  // lives in one array with each monkey's items at [first_item[m], first_item[m + 1]).
+  struct MonkeyTable {
+    std::vector<Operation> op;
+    std::vector<uint64_t> arg;
+    std::vector<Barrett> test;
+    std::vector<uint32_t> if_true;
+    std::vector<uint32_t> if_false;
+    std::vector<size_t> first_item;
+    std::vector<uint64_t> items;
+    Barrett mod;
+
+    size_t size() const {
+      return op.size();
     }
 
-    size_t getCount() const {
-      return insepected_;
+    void addMonkey() {
+      op.push_back(nullptr);
+      arg.push_back(0);
+      test.emplace_back();
+      if_true.push_back(0);
+      if_false.push_back(0);
+      first_item.push_back(items.size());
     }
-
-    friend std::ostream& operator<<(std::ostream& os, const Monkey& m);
-
-    protected:
-
-      int64_t performOperation(int64_t item) {
-        switch (op_) {
-          case OpType::Add:
-            return item + arg_;
-          case OpType::Mul:
-            return item * arg_;
-          case OpType::Pow:
-            return item * item;
-          case OpType::None:
-            break;
-        }
-        throw std::runtime_error("Bad optype");
-      }
-      ItemList items_;
-      OpType op_;
-      int64_t arg_;
-      int64_t test_;
-
-      size_t true_;
-      size_t false_;
-
-      size_t insepected_;
   };
-  using Monkeys = std::vector<Monkey>;
 
   STRING_CONSTANT(STR_MONKEY,    "Monkey ");
   STRING_CONSTANT(STR_ITEMS,     "  Starting items: ");
@@ -163,125 +157,212 @@ Monkey 3:
   STRING_CONSTANT(STR_TRUE,      "    If true: throw to monkey ");
   STRING_CONSTANT(STR_FALSE,     "    If false: throw to monkey ");
 
-#ifndef NDEBUG
-  std::ostream& operator<<(std::ostream& os, const Monkey& m) {
-    os << "Monkey (" << m.insepected_ << "): " << std::endl;
-    os << STR_ITEMS;
-    for (const auto i : m.items_) {
-      os << i << ' ';
-    }
-    os << std::endl;
-    os << STR_OPERATION << (char)m.op_ << ' ' << m.arg_ << std::endl;;
-    os << STR_TEST << m.test_ << std::endl;
-    os << STR_TRUE << m.true_ << std::endl;
-    os << STR_FALSE << m.false_ << std::endl;
-    return os;
-  }
-#endif
-
   const auto LoadInput = [](auto f) {
-    Monkeys ms;
+    MonkeyTable ms;
     std::string_view line;
-    ms.emplace_back();
-    Monkey* m = &ms.back();
-    int64_t mod = 1;
+    uint64_t mod = 1;
     while (aoc::getline(f, line, "\r\n", true)) {
       if (line.empty()) {
-        ms.emplace_back();
         continue;
       }
       else if (aoc::starts_with(line, STR_MONKEY)) {
-        m = &ms.back();
+        ms.addMonkey();
         continue;
       }
-      else if (aoc::starts_with(line, STR_ITEMS)) {
+      const auto m = ms.size() - 1;
+      if (aoc::starts_with(line, STR_ITEMS)) {
         const auto r = line.substr(STR_ITEMS.size());
-        aoc::parse_as_integers(r, ", ", [&m](int64_t i) { m->addItem(i); });
+        aoc::parse_as_integers(r, ", ", [&ms](int64_t i) { ms.items.push_back(i); });
         continue;
       } else if (aoc::starts_with(line, STR_OPERATION)) {
         size_t i = STR_OPERATION.size();
-        m->setOperation(ParseOptype(line.at(i++)));
+        auto op = ParseOptype(line.at(i++));
         assert(line.at(i) == ' ');
         i++;
         const auto r = line.substr(i);
         if (r == STR_OLD) {
-          m->setOperation(OpType::Pow);
-          m->setArg(2);
+          op = OpType::Pow;
+          ms.arg[m] = 2;
         } else {
-          m->setArg(aoc::stoi(line.substr(i)));
+          ms.arg[m] = aoc::stoi(r);
         }
+        ms.op[m] = CompileOperation(op);
         continue;
       } else if (aoc::starts_with(line, STR_TEST)) {
         const auto r = line.substr(STR_TEST.size());
         const auto t = aoc::stoi(r);
-        m->setTest(t);
+        ms.test[m] = Barrett(t);
         mod *= t;
         continue;
       } else if (aoc::starts_with(line, STR_TRUE)) {
         const auto r = line.substr(STR_TRUE.size());
-        m->setTrue(aoc::stoi(r));
+        ms.if_true[m] = aoc::stoi(r);
         continue;
       } else if (aoc::starts_with(line, STR_FALSE)) {
         const auto r = line.substr(STR_FALSE.size());
-        m->setFalse(aoc::stoi(r));
+        ms.if_false[m] = aoc::stoi(r);
         continue;
       }
       throw std::runtime_error("Bad Input");
     }
-    return std::pair{mod, ms};
+    ms.first_item.push_back(ms.items.size());
+    ms.mod = Barrett(mod);
+    return ms;
   };
-}
 
-int main(int argc, char** argv) {
-  aoc::AutoTimer t;
-  const bool inTest = argc < 2;
+  using Counts = std::vector<size_t>;
+
+  // Items never interact, so each one is followed on its own through its
+  // (monkey, worry) states, one round at a time.  An item thrown to a later
+  // monkey is inspected again in the same round; otherwise the round ends.
+  //
+  // With worry kept modulo the product of the tests there are finitely many
+  // states, so every item eventually repeats the state it started some
+  // earlier round in.  From there the inspections repeat too, and the rest of
+  // the rounds are covered arithmetically from the per-round prefix counts.
+  //
+  // `Relief` selects part 1's divide-by-3 at compile time, so the inner loop
+  // has no branch on the part being solved.
+  template<bool Relief>
+  class ItemSimulator {
+    public:
+      ItemSimulator(const MonkeyTable& ms)
+        : ms_(ms)
+      { }
+
+      Counts run(size_t rounds) const {
+        Counts counts(ms_.size(), 0);
+        std::mutex lock;
+        aoc::parallel_for(ms_.items.size(), [&](size_t begin, size_t end) {
+          Counts local(ms_.size(), 0);
+          for (size_t i = begin; i < end; i++) {
+            const auto owner = std::upper_bound(ms_.first_item.begin(), ms_.first_item.end(), i) - ms_.first_item.begin() - 1;
+            follow(owner, ms_.items[i], rounds, local);
+          }
+          std::lock_guard<std::mutex> l(lock);
+          for (size_t m = 0; m < counts.size(); m++) {
+            counts[m] += local[m];
+          }
+        });
+        return counts;
+      }
 
-  std::pair<int64_t, Monkeys> r;
+    private:
+      // Past this many rounds without a repeat, stop recording states and
+      // just keep simulating
+      static constexpr size_t MaxTrackedRounds = 1 << 20;
 
-  if (inTest) {
-    r = LoadInput(SampleInput);
-  } else {
-    std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
-    std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
-  }
-  Monkeys ms = r.second;
-  for (size_t i = 0; i < 20; i++) {
-    for (auto& m : ms) {
-      m.takeTurn(ms, 0);
-    }
-  }
+      // Advance one item by a round, counting its inspections
+      size_t round(size_t monkey, uint64_t& worry, size_t* counts) const {
+        while (true) {
+          counts[monkey]++;
+          worry = ms_.op[monkey](worry, ms_.arg[monkey]); // increase worry
+          // decrease worry
+          if constexpr (Relief) {
+            worry /= 3;
+          } else {
+            worry = ms_.mod.reduce(worry);
+          }
+          const size_t dst = ms_.test[monkey].divides(worry) ? ms_.if_true[monkey] : ms_.if_false[monkey];
+          assert(dst < ms_.size());
+          if (dst <= monkey) { return dst; }
+          monkey = dst;
+        }
+      }
+
+      void follow(size_t monkey, uint64_t worry, size_t rounds, Counts& out) const {
+        const size_t n = ms_.size();
+        // prefix[r * n + m]: inspections by monkey m in the first r rounds
+        Counts prefix(n, 0);
+        std::unordered_map<uint64_t, size_t> seen;
+        const bool track = !Relief && ms_.mod.divisor() < UINT64_MAX / n;
+
+        size_t r = 0;
+        for ( ; track && r < rounds && r < MaxTrackedRounds; r++) {
+          const auto key = worry * n + monkey;
+          const auto [it, inserted] = seen.emplace(key, r);
+          if (!inserted) {
+            const auto start = it->second;
+            const auto length = r - start;
+            const auto cycles = (rounds - r) / length;
+            const auto rest = (rounds - r) % length;
+            DEBUG_LOG(start, length);
+            for (size_t m = 0; m < n; m++) {
+              const auto per_cycle = prefix[r * n + m] - prefix[start * n + m];
+              const auto partial = prefix[(start + rest) * n + m] - prefix[start * n + m];
+              out[m] += prefix[r * n + m] + cycles * per_cycle + partial;
+            }
+            return;
+          }
+          prefix.resize(prefix.size() + n);
+          std::copy_n(&prefix[r * n], n, &prefix[(r + 1) * n]);
+          monkey = round(monkey, worry, &prefix[(r + 1) * n]);
+        }
+
+        Counts counts(prefix.end() - n, prefix.end());
+        for ( ; r < rounds; r++) {
+          monkey = round(monkey, worry, counts.data());
+        }
+        for (size_t m = 0; m < n; m++) {
+          out[m] += counts[m];
+        }
+      }
 
-  const auto Solve = [&ms]() {
+      const MonkeyTable& ms_;
+  };
+
+  // Each count fits in 64 bits, but at very high round counts their product
+  // does not, so it is worked out in 128 bits and printed as a string
+  using Business = unsigned __int128;
+
+  const auto MonkeyBusiness = [](const Counts& counts) {
     size_t max1 = 0;
     size_t max2 = 0;
-    for (const auto& m : ms) {
-      DEBUG_LOG(m);
-      if (m.getCount() > max1) {
+    for (const auto c : counts) {
+      if (c > max1) {
         max2 = max1;
-        max1 = m.getCount();
-      } else if (m.getCount() > max2) {
-        max2 = m.getCount();
+        max1 = c;
+      } else if (c > max2) {
+        max2 = c;
       }
     }
-    return max1 * max2;
+    return Business{max1} * max2;
   };
-  size_t part1 = Solve();
 
-  ms = r.second;
-  for (size_t i = 0; i < 10000; i++) {
-    for (auto& m : ms) {
-      m.takeTurn(ms, r.first);
-    }
+  const auto ToString = [](Business v) {
+    std::string digits;
+    do {
+      digits.push_back('0' + static_cast<char>(v % 10));
+      v /= 10;
+    } while (v);
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+  };
+}
+
+int main(int argc, char** argv) {
+  aoc::AutoTimer t;
+  const bool inTest = argc < 2;
+
+  MonkeyTable ms;
+
+  if (inTest) {
+    ms = LoadInput(SampleInput);
+  } else {
+    std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
+    std::string_view f(m->data(), m->size());
+    ms = LoadInput(f);
   }
+  const size_t rounds = argc > 2 ? aoc::stoi(argv[2]) : 10000;
 
-  size_t part2 = Solve();
+  const auto part1 = ToString(MonkeyBusiness(ItemSimulator<true>(ms).run(20)));
+  const auto part2 = ToString(MonkeyBusiness(ItemSimulator<false>(ms).run(rounds)));
 
   aoc::print_results(part1, part2);
 
   if (inTest) {
-    aoc::assert_result(part1, SR_Part1);
-    aoc::assert_result(part2, SR_Part2);
+    aoc::assert_result(part1, std::to_string(SR_Part1));
+    aoc::assert_result(part2, std::to_string(SR_Part2));
   }
 
   return 0;
@@ -1,7 +1,6 @@
 #include "aoc/helpers.h"
-#include <set>
+#include <algorithm>
 #include <vector>
-#include <map>
 
 namespace {
   using Result = std::pair<int, int>;
@@ -15,111 +14,140 @@ abdefghi)");
   constexpr int SR_Part1 = 31;
   constexpr int SR_Part2 = 29;
 
-  // Height (as character), steps to get there
-  using MapPoint = std::pair<int8_t, int64_t>;
-  using Map = std::vector<MapPoint>;
-
-  using Point = std::pair<size_t, size_t>;
+  // Heights stored row-major, 0 for 'a' up to 25 for 'z'
   struct Grid {
-    Map map;
-    size_t width;
-    size_t height;
-
-    Point start;
-    Point dst;
-    int64_t min_a;
-  };
-
-  const auto grid_off = [](const Grid& g, size_t x, size_t y) {
-    assert(x < g.width);
-    assert(y < g.height);
-    return y * g.width + x;
-  };
-
-  const auto grid_add = [](Grid& g, size_t x, size_t y, char c) {
-    const size_t off = grid_off(g, x, y);
-    assert(off < g.map.size());
-    auto& e = g.map.at(off);
-    if (c == 'S') { c = 'a'; }
-    else if (c == 'E') { c = 'z'; }
-    e.first = c - 'a';
-    e.second = -1;
-  };
-
-  const auto grid_set_width = [](Grid& g, size_t w) {
-    assert(!g.width || g.width == w);
-    if (g.width) { return; }
-    g.width = w;
-  };
-
-  const auto grid_add_row = [](Grid& g) {
-    assert(g.width);
+    std::vector<uint8_t> heights;
+    size_t width{0};
+    size_t height{0};
 
-    g.height ++;
-    g.map.resize(g.width * g.height);
+    size_t start{0};
+    size_t dst{0};
   };
 
   const auto LoadInput = [](auto f) {
     Grid g;
     std::string_view line;
-    g.width = 0;
-    g.height = 0;
     while (aoc::getline(f, line)) {
-      grid_set_width(g, line.size());
-      grid_add_row(g);
+      assert(!g.width || g.width == line.size());
+      g.width = line.size();
 
-      size_t x = 0;
-      const auto y = g.height - 1;
-      for (const auto c : line) {
+      for (auto c : line) {
         assert((c >= 'a' && c <= 'z') || c == 'E' || c == 'S');
-        DEBUG_LOG(x, y, c);
-        grid_add(g, x, y, c);
-
         if (c == 'S') {
-          g.start.first = x;
-          g.start.second = y;
+          g.start = g.heights.size();
+          c = 'a';
         } else if (c == 'E') {
-          g.dst.first = x;
-          g.dst.second = y;
+          g.dst = g.heights.size();
+          c = 'z';
         }
-        x++;
+        g.heights.push_back(c - 'a');
       }
+      g.height++;
     }
     return g;
   };
 
-  void flood_fill(Grid& g, size_t x, size_t y, int32_t last, int64_t step) {
-    auto& p = g.map.at(grid_off(g, x, y));
-    DEBUG_LOG(x, y, last, p.first, p.second, step);
-    // already colored
-    if (p.second != -1 && step >= p.second) {
-      return;
-    }
+  constexpr int32_t Unreached = -1;
+
+  // Distance from every cell to E, kept after the search so that any number
+  // of start points can be queried.  Cells are recorded in the order the
+  // search reaches them, which is nearest first, so the per-height lists are
+  // already sorted by distance.
+  class DistanceField {
+    public:
+      struct Cell {
+        size_t x;
+        size_t y;
+        int32_t distance;
+      };
+
+      DistanceField(const Grid& g)
+        : g_(g)
+        , dist_(g.heights.size(), Unreached)
+        , by_height_(26)
+      { }
+
+      void record(size_t cell, int32_t d) {
+        dist_[cell] = d;
+        by_height_[g_.heights[cell]].push_back(cell);
+      }
 
-    const auto diff = last - p.first;
-    // Can't get to here
-    if (diff > 1) { return; }
+      int32_t distance(size_t cell) const {
+        return dist_[cell];
+      }
 
-    p.second = step++;
-    // This is a possilbe start point for part 2
-    if (p.first == 0) {
-      g.min_a = std::min(g.min_a, p.second);
-    }
-    // This is the start, return, no need to take another step
-    if (x == g.start.first && y == g.start.second) {
-      return;
-    }
-    if (x + 1 < g.width) {
-      flood_fill(g, x + 1, y, p.first, step);
-    }
-    if (x > 0) {
-      flood_fill(g, x - 1, y, p.first, step);
-    }
-    if (y + 1 < g.height) {
-      flood_fill(g, x, y + 1, p.first, step);
+      int32_t distance(size_t x, size_t y) const {
+        if (x >= g_.width || y >= g_.height) { return Unreached; }
+        return dist_[y * g_.width + x];
+      }
+
+      // Up to `k` of the cells of height `h` nearest to E
+      std::vector<Cell> nearest(uint8_t h, size_t k) const {
+        std::vector<Cell> out;
+        const auto& cells = by_height_.at(h);
+        for (size_t i = 0; i < std::min(k, cells.size()); i++) {
+          out.push_back({ cells[i] % g_.width, cells[i] / g_.width, dist_[cells[i]] });
+        }
+        return out;
+      }
+
+      Result solve() const {
+        const auto a = nearest(0, 1);
+        return { distance(g_.start), a.empty() ? Unreached : a.front().distance };
+      }
+
+    private:
+      const Grid& g_;
+      std::vector<int32_t> dist_;
+      std::vector<std::vector<uint32_t>> by_height_;
+  };
+
+  // Breadth first search backwards from E.  A step may climb at most one, so
+  // walking backwards it may drop at most one.  Each cell is queued once, in
+  // order of distance.
+  const auto Search = [](const Grid& g) {
+    DistanceField field(g);
+    std::vector<uint32_t> queue(g.heights.size());
+    size_t head = 0;
+    size_t tail = 0;
+
+    field.record(g.dst, 0);
+    queue[tail++] = g.dst;
+    while (head < tail) {
+      const size_t c = queue[head++];
+      const auto h = g.heights[c];
+      const auto d = field.distance(c) + 1;
+
+      const auto visit = [&](size_t n) {
+        if (field.distance(n) != Unreached || h > g.heights[n] + 1) { return; }
+        field.record(n, d);
+        queue[tail++] = n;
+      };
+      const size_t x = c % g.width;
+      if (x + 1 < g.width) { visit(c + 1); }
+      if (x > 0) { visit(c - 1); }
+      if (c + g.width < g.heights.size()) { visit(c + g.width); }
+      if (c >= g.width) { visit(c - g.width); }
     }
-    if (y > 0) {
-      flood_fill(g, x, y - 1, p.first, step);
+    return field;
+  };
+
+  // Queries given after the input: `x,y` for the steps from that cell, or
+  // `h:k` for the k cells of height h nearest to E
+  const auto Query = [](const DistanceField& field, std::string_view q) {
+    const auto comma = q.find(',');
+    const auto colon = q.find(':');
+    if (comma != std::string_view::npos) {
+      const auto x = aoc::stoi(q.substr(0, comma));
+      const auto y = aoc::stoi(q.substr(comma + 1));
+      std::cout << q << ": " << field.distance(x, y) << std::endl;
+    } else if (colon == 1 && q[0] >= 'a' && q[0] <= 'z') {
+      const auto k = aoc::stoi(q.substr(colon + 1));
+      for (const auto& c : field.nearest(q[0] - 'a', k)) {
+        std::cout << q[0] << ": " << c.x << "," << c.y << " " << c.distance << std::endl;
+      }
+    } else {
+      throw std::runtime_error("Bad query: " + std::string(q));
     }
   };
 }
@@ -137,11 +165,14 @@ int main(int argc, char** argv) {
     g = LoadInput(f);
   }
 
-  g.min_a = INT64_MAX;
-  flood_fill(g, g.dst.first, g.dst.second, 26, 0);
+  const auto field = Search(g);
+  for (int i = 2; i < argc; i++) {
+    Query(field, argv[i]);
+  }
 
-  int64_t part1 = g.map.at(grid_off(g, g.start.first, g.start.second)).second;
-  int64_t part2 = g.min_a;
+  int64_t part1 = 0;
+  int64_t part2 = 0;
+  std::tie(part1, part2) = field.solve();
 
   aoc::print_results(part1, part2);
 
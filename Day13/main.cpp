@@ -1,8 +1,11 @@
 #include "aoc/helpers.h"
+#include "aoc/parallel.h"
 #include <vector>
-#include <variant>
 #include <algorithm>
+#include <atomic>
 #include <charconv>
+#include <mutex>
+#include <numeric>
 
 namespace {
   using Result = std::pair<int, int>;
@@ -34,99 +37,170 @@ namespace {
   constexpr int SR_Part1 = 13;
   constexpr int SR_Part2 = 140;
 
-  struct Value
-    : public std::variant<int, std::vector<Value>>
-  {
-    Value()
-      : variant(0)
-    {}
-    Value(int v)
-      : variant(v)
-    {}
-    Value(const std::vector<Value>& v)
-      : variant(v)
-    {}
-
-    bool operator<(const Value& rhs) const;
-  };
+  // Packets are flattened into tokens: list brackets as negative markers and
+  // integers as themselves.  Every packet lives in one shared arena.
+  using Token = int32_t;
+  constexpr Token Open = -1;
+  constexpr Token Close = -2;
 
-  struct ValueComparator {
-    bool operator()(int l, int r) const {
-      return l < r;
-    }
-    bool operator()(const std::vector<Value>& l, const std::vector<Value>& r) const {
-      return std::lexicographical_compare(l.cbegin(), l.cend(), r.cbegin(), r.cend());
-    }
-    bool operator()(int l, const std::vector<Value>& r) const {
-      return operator()(std::vector<Value>{l}, r);
-    }
-    bool operator()(const std::vector<Value>& l, int r) const {
-      return operator()(l, std::vector<Value>{r});
-    }
+  struct Packet {
+    uint32_t begin;
+    uint32_t end;
   };
 
-  bool Value::operator<(const Value& rhs) const {
-    static ValueComparator vc;
-    return std::visit(vc, *this, rhs);
-  }
+  class PacketArena {
+    public:
+      Packet add(std::string_view line) {
+        Packet p{ static_cast<uint32_t>(tokens_.size()), 0 };
+        for (size_t i = 0; i < line.size(); ) {
+          const auto c = line[i];
+          if (c == '[') {
+            tokens_.push_back(Open);
+            i++;
+          } else if (c == ']') {
+            tokens_.push_back(Close);
+            i++;
+          } else if (c == ',') {
+            i++;
+          } else {
+            Token v = 0;
+            const auto r = std::from_chars(line.data() + i, line.data() + line.size(), v);
+            if (r.ec != std::errc()) {
+              throw std::runtime_error("Bad packet: " + std::string(line));
+            }
+            tokens_.push_back(v);
+            i = r.ptr - line.data();
+          }
+        }
+        p.end = tokens_.size();
+        return p;
+      }
 
-  Value ParseValue(std::string_view& line) {
-    if (line[0] != '[') {
-      // int
-      int v;
-      const auto end = line.data() + line.size();
-      auto p = std::from_chars(line.data(), end, v);
-      const auto prefix = p.ptr - line.data();
-      line.remove_prefix(prefix);
-      return v;
-    } else {
-      std::vector<Value> v;
-      if (line[1] == ']') { // empty vector
-        line.remove_prefix(2);
-        return v;
+      // Returns <0, 0 or >0 as `a` orders before, with or after `b`.
+      //
+      // Both packets are scanned with a cursor each.  An integer compared
+      // against a list is promoted virtually: the list's '[' is consumed and
+      // the integer's side owes one extra ']' once the integer is consumed, so
+      // nothing is ever copied or allocated.
+      int compare(const Packet& a, const Packet& b) const {
+        const Token* t = tokens_.data();
+        uint32_t i = a.begin;
+        uint32_t j = b.begin;
+        // Virtual ']' owed after the current integer, and those now due
+        uint32_t owed_a = 0, due_a = 0;
+        uint32_t owed_b = 0, due_b = 0;
+
+        const auto advance = [](uint32_t& cursor, uint32_t& owed, uint32_t& due) {
+          if (due) { due--; return; }
+          cursor++;
+          due = owed;
+          owed = 0;
+        };
+
+        while (i < a.end || due_a) {
+          assert(j < b.end || due_b);
+          const Token x = due_a ? Close : t[i];
+          const Token y = due_b ? Close : t[j];
+          if (x >= 0 && y >= 0) {
+            if (x != y) { return x < y ? -1 : 1; }
+            advance(i, owed_a, due_a);
+            advance(j, owed_b, due_b);
+          } else if (x == y) {
+            advance(i, owed_a, due_a);
+            advance(j, owed_b, due_b);
+          } else if (x == Close) {
+            return -1;
+          } else if (y == Close) {
+            return 1;
+          } else if (x == Open) {
+            // list against integer
+            advance(i, owed_a, due_a);
+            owed_b++;
+          } else {
+            // integer against list
+            advance(j, owed_b, due_b);
+            owed_a++;
+          }
+        }
+        return (j < b.end || due_b) ? -1 : 0;
       }
 
-      // consume one list at a timme
-      while (line[0] != ']') {
-        line.remove_prefix(1);
-        v.push_back(ParseValue(line));
+      bool less(const Packet& a, const Packet& b) const {
+        return compare(a, b) < 0;
       }
-      // consume ']'
-      line.remove_prefix(1);
 
-      return v;
-    }
-  }
+    private:
+      std::vector<Token> tokens_;
+  };
 
   STRING_CONSTANT(DIV_1, "[[2]]");
   STRING_CONSTANT(DIV_2, "[[6]]");
 
-  const auto LoadInput = [](auto f) {
-    Result r{0, 0};
-    std::string_view line;
-    std::vector<Value>values;
-    while (aoc::getline(f, line)) {
-      values.push_back(ParseValue(line));
+  // Sum of the 1-based indexes of the pairs already in the right order
+  const auto OrderedPairs = [](const PacketArena& arena, const std::vector<Packet>& packets) {
+    std::atomic<size_t> sum{0};
+    aoc::parallel_for(packets.size() / 2, [&](size_t begin, size_t end) {
+      size_t local = 0;
+      for (size_t i = begin; i < end; i++) {
+        local += arena.less(packets[2 * i], packets[2 * i + 1]) ? i + 1 : 0;
+      }
+      sum += local;
+    }, 256);
+    return sum.load();
+  };
+
+  // For each probe, the number of packets which order before it.  Probes are
+  // sorted once so each packet needs only a binary search over the probes,
+  // and the packets are split across threads.
+  const auto Rank = [](const PacketArena& arena, const std::vector<Packet>& packets, const std::vector<Packet>& probes) {
+    const auto less = [&arena](const Packet& a, const Packet& b) { return arena.less(a, b); };
+    std::vector<size_t> order(probes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return less(probes[a], probes[b]); });
+    std::vector<Packet> sorted;
+    for (const auto i : order) {
+      sorted.push_back(probes[i]);
+    }
 
-      if (!(values.size() % 2)) {
-        const auto& lhs = values.at(values.size() - 2);
-        const auto& rhs = values.back();
-        r.first += (lhs < rhs ? (values.size() / 2) : 0);
+    // below[k]: packets which order before sorted probe k but not k - 1
+    std::vector<size_t> below(sorted.size() + 1, 0);
+    std::mutex m;
+    aoc::parallel_for(packets.size(), [&](size_t begin, size_t end) {
+      std::vector<size_t> local(below.size(), 0);
+      for (size_t i = begin; i < end; i++) {
+        local[std::upper_bound(sorted.begin(), sorted.end(), packets[i], less) - sorted.begin()]++;
       }
+      std::lock_guard<std::mutex> l(m);
+      for (size_t k = 0; k < below.size(); k++) {
+        below[k] += local[k];
+      }
+    }, 256);
+
+    std::vector<size_t> ranks(probes.size());
+    size_t running = 0;
+    for (size_t k = 0; k < sorted.size(); k++) {
+      running += below[k];
+      ranks[order[k]] = running;
+    }
+    return ranks;
+  };
+
+  const auto LoadInput = [](auto f, PacketArena& arena) {
+    std::string_view line;
+    std::vector<Packet> packets;
+    while (aoc::getline(f, line)) {
+      packets.push_back(arena.add(line));
     }
-    line = DIV_1;
-    const auto div1 = ParseValue(line);
-    line = DIV_2;
-    const auto div2 = ParseValue(line);
-    // add the two divider packets, sort and locate indicies
-    values.push_back(div1);
-    values.push_back(div2);
-
-    std::sort(values.begin(), values.end());
-    const auto idx1 = std::lower_bound(values.cbegin(), values.cend(), div1) - values.begin();
-    const auto idx2 = std::lower_bound(values.cbegin(), values.cend(), div2) - values.begin();
-
-    r.second = (idx1 + 1) * (idx2 + 1);
+    return packets;
+  };
+
+  const auto Solve = [](PacketArena& arena, const std::vector<Packet>& packets) {
+    Result r{0, 0};
+    r.first = OrderedPairs(arena, packets);
+
+    // Once both dividers are added, the second also sits after the first
+    const auto ranks = Rank(arena, packets, { arena.add(DIV_1), arena.add(DIV_2) });
+    r.second = (ranks[0] + 1) * (ranks[1] + 2);
     return r;
   };
 }
@@ -135,15 +209,30 @@ int main(int argc, char** argv) {
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
-  Result r;
+  PacketArena arena;
+  std::vector<Packet> packets;
   if (inTest) {
-    r = LoadInput(SampleInput);
+    packets = LoadInput(SampleInput, arena);
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    packets = LoadInput(f, arena);
+  }
+
+  // Rank any probe packets given after the input
+  if (argc > 2) {
+    std::vector<Packet> probes;
+    for (int i = 2; i < argc; i++) {
+      probes.push_back(arena.add(argv[i]));
+    }
+    const auto ranks = Rank(arena, packets, probes);
+    for (int i = 2; i < argc; i++) {
+      std::cout << argv[i] << ": " << ranks[i - 2] << std::endl;
+    }
   }
 
+  const auto r = Solve(arena, packets);
+
   int part1 = 0;
   int part2 = 0;
 
@@ -1,12 +1,14 @@
 #include "aoc/helpers.h"
+#include <algorithm>
+#include <optional>
 #include <vector>
-#include <unordered_map>
 #include <thread>
 
 using namespace std::chrono_literals;
 
 namespace {
-  bool visualize =
+  // Compile time, so release builds carry no trace of the animation
+  constexpr bool Visualize =
 #ifndef NDEBUG
     true;
 #else
@@ -21,134 +23,144 @@ namespace {
   constexpr int SR_Part1 = 24;
   constexpr int SR_Part2 = 93;
 
- enum class Tile {
-    Air = 0,
+  enum class Tile : uint8_t {
+    Air = ' ',
     Rock = '#',
     Sand = 'O',
   };
 
-  using SparseGrid = std::unordered_map<aoc::Point, Tile, aoc::PointHash>;
-
-  class Map {
+  using RockLine = std::pair<aoc::Point, aoc::Point>;
+  constexpr aoc::Point Source{500, 0};
+
+  // Dense cave with a floor two rows below the lowest rock.  Sand piles up at
+  // most one cell further out per row, so the grid only needs to span the
+  // floor depth either side of the source.
+  //
+  // The path of the previous grain is kept as a stack.  The next grain
+  // follows the same path until the cell where the last one came to rest, so
+  // it resumes from the cell before that rather than the source.
+  class Cave {
   public:
-    Map()
-      : width(0)
-      , depth(0)
-      , ptmin(INT_MAX, INT_MAX)
-      , ptmax(INT_MIN, INT_MIN)
+    Cave(const std::vector<RockLine>& lines)
+      : maxy_(0)
     {
-    }
-
-    void add_rock_line(aoc::Point f, aoc::Point t) {
-      auto diff = t - f;
-      const auto xstep = aoc::sgn(diff.first);
-      const auto ystep = aoc::sgn(diff.second);
-      diff = aoc::abs(diff);
-
-      const auto max = aoc::max(f, t);
-      const auto min = aoc::min(f, t);
-
-      resize_grid(min, max);
-      ptmax = aoc::max(max, ptmax);
+      int64_t minx = Source.first;
+      int64_t maxx = Source.first;
+      for (const auto& [f, t] : lines) {
+        minx = std::min({ minx, f.first, t.first });
+        maxx = std::max({ maxx, f.first, t.first });
+        maxy_ = std::max({ maxy_, f.second, t.second });
+      }
+      const int64_t floor = maxy_ + 2;
+      minx_ = std::min(minx, Source.first - floor) - 1;
+      width_ = std::max(maxx, Source.first + floor) + 2 - minx_;
+      grid_.assign(width_ * (floor + 1), Tile::Air);
 
-      if (diff.second) {
-        for (auto y = 0; y <= diff.second; y++) {
-          sg.emplace(f, Tile::Rock);
-          f += { xstep, ystep };
-        }
-      } else if (diff.first) {
-        for (auto x = 0; x <= diff.first; x++) {
-          sg.emplace(f, Tile::Rock);
-          f += { xstep, ystep };
-        }
+      for (const auto& [f, t] : lines) {
+        add_rock_line(f, t);
       }
+      for (int64_t x = 0; x < width_; x++) {
+        grid_[floor * width_ + x] = Tile::Rock;
+      }
+      path_.push_back(index(Source));
     }
 
     // returns true if sand settles
-    bool drop_sand(const aoc::Point& epoch, bool fill) {
-      aoc::Point pt = epoch;
-      const aoc::Point DOWN{0, 1};
-      const aoc::Point DOWN_LEFT{-1, 1};
-      const aoc::Point DOWN_RIGHT{1, 1};
-
-      const auto floor = ptmax.second + (2 * fill);
+    bool drop_sand(bool fill) {
+      const size_t abyss = maxy_ * width_;
 
-      if (sg.find(pt) != sg.end()) {
+      // Back up the last grain's path to the last cell still open
+      while (!path_.empty() && grid_[path_.back()] != Tile::Air) {
+        path_.pop_back();
+      }
+      if (path_.empty()) {
         return false;
       }
 
-      aoc::Point last = pt;
-      while (pt.second < floor) {
-        last = pt;
-        auto cur = sg.find(last);
-
-        aoc::Point down = pt + DOWN;
-        aoc::Point down_left = pt + DOWN_LEFT;
-        aoc::Point down_right = pt + DOWN_RIGHT;
-
-        resize_grid(down_left, down_right);
-
-        if (sg.find(down) == sg.end()) {
-          pt = down;
-        } else if (sg.find(down_left) == sg.end()) {
-          pt = down_left;
-        } else if (sg.find(down_right) == sg.end()) {
-          pt = down_right;
-        }
-        
-        if (pt == last) {
-          DEBUG_LOG(last);
-          sg.emplace(pt, Tile::Sand);
-          return true;
+      while (true) {
+        const size_t pt = path_.back();
+        if (!fill && pt >= abyss) {
+          return false;
         }
 
-        if (cur != sg.end()) {
-          sg.erase(cur);
+        const size_t down = pt + width_;
+        if (grid_[down] == Tile::Air) {
+          path_.push_back(down);
+        } else if (grid_[down - 1] == Tile::Air) {
+          path_.push_back(down - 1);
+        } else if (grid_[down + 1] == Tile::Air) {
+          path_.push_back(down + 1);
+        } else {
+          grid_[pt] = Tile::Sand;
+          return true;
         }
 
-        if (visualize) {
+        if constexpr (Visualize) {
           std::this_thread::sleep_for(5ms);
           aoc::cls(std::cout);
           std::cout << *this;
         }
       }
-      // If fill, we emplace the sand at the point before we fell through the floor
-      if (fill) {
-        DEBUG_LOG(last);
-        sg.emplace(last, Tile::Sand);
-        return true;
-      }
+    }
 
-      return false;
+    // Every cell sand can reach from the source ends up filled, and a cell is
+    // reachable when any of the three cells above it is.  So the part 2 total
+    // is a row by row sweep: spread the previous row's reachable bits one
+    // column each way, mask out rock, and count.
+    size_t count_reachable() const {
+      const size_t words = (width_ + 63) / 64;
+      std::vector<uint64_t> row(words, 0);
+      std::vector<uint64_t> rock(words);
+      const size_t source = index(Source);
+      row[source / 64] |= uint64_t{1} << (source % 64);
+
+      size_t total = 1;
+      const int64_t floor = maxy_ + 2;
+      for (int64_t y = 1; y < floor; y++) {
+        std::fill(rock.begin(), rock.end(), 0);
+        for (int64_t x = 0; x < width_; x++) {
+          rock[x / 64] |= uint64_t{grid_[y * width_ + x] == Tile::Rock} << (x % 64);
+        }
+
+        uint64_t carry_left = 0;
+        for (size_t w = 0; w < words; w++) {
+          const uint64_t cur = row[w];
+          const uint64_t carry_right = w + 1 < words ? row[w + 1] << 63 : 0;
+          row[w] = (cur | (cur << 1) | carry_left | (cur >> 1) | carry_right) & ~rock[w];
+          carry_left = cur >> 63;
+          total += __builtin_popcountll(row[w]);
+        }
+      }
+      return total;
     }
 
-    friend std::ostream& operator<<(std::ostream& os, const Map& m);
+    friend std::ostream& operator<<(std::ostream& os, const Cave& m);
 
   protected:
 
-    void resize_grid(const aoc::Point& min, const aoc::Point& max) {
-      ptmin = aoc::min(min, ptmin);
-      width = std::max(width, static_cast<size_t>(max.first) + 1);
-      depth = std::max(depth, static_cast<size_t>(max.second) + 1);
+    size_t index(const aoc::Point& p) const {
+      return p.second * width_ + (p.first - minx_);
     }
 
-    size_t width;
-    size_t depth;
-    aoc::Point ptmin;
-    aoc::Point ptmax;
-    SparseGrid sg;
+    void add_rock_line(aoc::Point f, aoc::Point t) {
+      const aoc::Point step{ aoc::sgn(t.first - f.first), aoc::sgn(t.second - f.second) };
+      grid_[index(f)] = Tile::Rock;
+      while (f != t) {
+        f += step;
+        grid_[index(f)] = Tile::Rock;
+      }
+    }
+
+    int64_t maxy_;
+    int64_t minx_;
+    int64_t width_;
+    std::vector<Tile> grid_;
+    std::vector<size_t> path_;
   };
 
-  std::ostream& operator<<(std::ostream& os, const Map& m) {
-    for (size_t y = m.ptmin.second; y < m.depth; y++) {
-      for (size_t x = m.ptmin.first; x < m.width; x++) {
-        const auto t = m.sg.find({x, y});
-        if (t == m.sg.end()) {
-          os << ' ';
-        } else {
-          os << static_cast<char>(t->second);
-        }
-      }
+  std::ostream& operator<<(std::ostream& os, const Cave& m) {
+    for (size_t y = 0; y < m.grid_.size() / m.width_; y++) {
+      os.write(reinterpret_cast<const char*>(&m.grid_[y * m.width_]), m.width_);
       os << std::endl;
     }
     return os;
@@ -156,7 +168,7 @@ namespace {
 
   const auto LoadInput = [](auto f) {
     std::string_view line;
-    Map m;
+    std::vector<RockLine> lines;
     while (aoc::getline(f, line)) {
       std::vector<int>points;
       aoc::parse_as_integers(line, " ->,",
@@ -167,11 +179,11 @@ namespace {
       aoc::Point last = {points[0],points[1]};
       for (size_t i = 0; i < points.size(); i += 2) {
         aoc::Point cur{points[i],points[i + 1]};
-        m.add_rock_line(last, cur);
+        lines.emplace_back(last, cur);
         last.swap(cur);
       }
     }
-    return m;
+    return Cave(lines);
   };
 }
 
@@ -179,7 +191,7 @@ int main(int argc, char** argv) {
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
-  Map r;
+  std::optional<Cave> r;
   if (inTest) {
     r = LoadInput(SampleInput);
   } else {
@@ -192,22 +204,28 @@ int main(int argc, char** argv) {
   int part2 = 0;
   {
     aoc::AutoTimer t("part 1");
-    while (r.drop_sand({500, 0}, false)) {
+    while (r->drop_sand(false)) {
       part1++;
     }
   }
 
 
   {
-    part2 = part1;
     aoc::AutoTimer t("part 2");
-    while (r.drop_sand({500, 0}, true)) {
-      part2++;
+    part2 = r->count_reachable();
+  }
+
+  // Check the sweep against a grain by grain simulation
+  if (inTest || Visualize) {
+    int simulated = part1;
+    while (r->drop_sand(true)) {
+      simulated++;
     }
+    aoc::assert_result(simulated, part2);
   }
 
   DEBUG(aoc::cls(std::cout));
-  DEBUG(std::cout << r);
+  DEBUG(std::cout << *r);
 
   aoc::print_results(part1, part2);
 
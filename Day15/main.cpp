@@ -1,5 +1,12 @@
 #include "aoc/helpers.h"
+#include "aoc/interval_set.h"
+#include "aoc/parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace {
@@ -27,7 +34,9 @@ Sensor at x=20, y=1: closest beacon is at x=15, y=3)");
   using Beacon = std::pair<aoc::Point, int64_t>;
   using Report = std::unordered_map<aoc::Point, int64_t, aoc::PointHash>;
 
-  const auto LoadInput = [](auto f) {
+  using Beacons = std::unordered_set<aoc::Point, aoc::PointHash>;
+
+  const auto LoadInput = [](auto f, Beacons& beacons) {
     Report r;
     std::string_view line;
     while (aoc::getline(f, line)) {
@@ -39,56 +48,160 @@ Sensor at x=20, y=1: closest beacon is at x=15, y=3)");
       aoc::Point beacon{points[2], points[3]};
       const auto radius = aoc::manhattan(sensor, beacon);
       r.emplace(sensor, radius);
+      beacons.insert(beacon);
     }
     return r;
   };
 
-  using Ranges = std::vector<aoc::Point>;
-
-  const auto reduceCoveredRanges = [](Ranges& r) {
-    Ranges out;
-    if (r.empty()) { return out; }
-    std::sort(r.begin(), r.end());
-    auto last = r.front();
-    for (const auto& span : r) {
-      // completely encompassed
-      if (span.first >= last.first && span.second <= last.second) {
-        continue;
-      } else if ((span.first <= last.first && span.second > last.first) ||
-                (span.first <= last.second && span.second > last.second))
-      { // overlap, so extend
-        last.first = std::min(span.first, last.first);
-        last.second = std::max(span.second, last.second);
-      } else { // no overlap
-        out.emplace_back(last);
-        last = span;
-      }
+  using Ranges = std::vector<aoc::IntervalSet::Interval>;
+
+  // The cells of `row` within range of any sensor
+  const auto getCoveredRow = [](const Report& r, int64_t row) {
+    Ranges spans;
+    for (const auto& [sensor, radius] : r) {
+      // reduce the radius to account for the row to signal offset
+      const int64_t distance = radius - std::abs(row - sensor.second);
+      if (distance < 0) { continue; }
+      spans.emplace_back(sensor.first - distance, sensor.first + distance);
     }
-    out.emplace_back(last);
-    return out;
+    std::sort(spans.begin(), spans.end());
+    aoc::IntervalSet covered;
+    covered.insert_sorted(spans);
+    return covered;
   };
 
-  const auto getCoveredRanges = [](const Report& r, int64_t row) {
-    Ranges covered_range;
+  const auto isCovered = [](const Report& r, const aoc::Point& p) {
     for (const auto& [sensor, radius] : r) {
+      if (aoc::manhattan(sensor, p) <= radius) { return true; }
+    }
+    return false;
+  };
 
-      // if the target row is not in the signal area, skip
-      if (row > sensor.second + radius ||
-          row < sensor.second - radius) {
-        continue;
-      }
+  // A lone uncovered point must sit just outside the edge of every sensor
+  // around it, so it lies on the radius + 1 boundary diagonals of the
+  // sensors, or against the edge of the search area.  The diagonals are the
+  // lines x + y = a and x - y = b, so every candidate is an intersection of
+  // two such lines (or of one with the search area edge), and each is checked
+  // against all sensors.  The work depends only on the number of sensors.
+  const auto findDistressBeacon = [](const Report& r, int64_t limit) -> std::optional<aoc::Point> {
+    std::vector<int64_t> as;
+    std::vector<int64_t> bs;
+    for (const auto& [sensor, radius] : r) {
+      const auto [x, y] = sensor;
+      as.push_back(x + y + radius + 1);
+      as.push_back(x + y - radius - 1);
+      bs.push_back(x - y + radius + 1);
+      bs.push_back(x - y - radius - 1);
+    }
+    for (auto* v : { &as, &bs }) {
+      std::sort(v->begin(), v->end());
+      v->erase(std::unique(v->begin(), v->end()), v->end());
+    }
 
-      // reduce the radius to account for the row to signal offset
-      const int distance = (row > sensor.second) ?
-        ((sensor.second + radius) - row) :
-        row - (sensor.second - radius);
+    const auto check = [&](const aoc::Point& p) {
+      return p.first >= 0 && p.first <= limit && p.second >= 0 && p.second <= limit &&
+        !isCovered(r, p);
+    };
 
-      if (!distance) { continue; }
+    for (const auto a : as) {
+      for (const auto b : bs) {
+        if ((a + b) % 2) { continue; }
+        const aoc::Point p{ (a + b) / 2, (a - b) / 2 };
+        if (check(p)) { return p; }
+      }
+    }
 
-      // all these points are covered
-      covered_range.emplace_back(sensor.first - distance, sensor.first + distance);
+    // Against the edges of the search area, only one diagonal bounds it
+    for (const auto edge : { int64_t{0}, limit }) {
+      for (const auto a : as) {
+        for (const auto& p : { aoc::Point{ edge, a - edge }, aoc::Point{ a - edge, edge } }) {
+          if (check(p)) { return p; }
+        }
+      }
+      for (const auto b : bs) {
+        for (const auto& p : { aoc::Point{ edge, edge - b }, aoc::Point{ edge + b, edge } }) {
+          if (check(p)) { return p; }
+        }
+      }
+      for (const auto other : { int64_t{0}, limit }) {
+        if (check({ edge, other })) { return aoc::Point{ edge, other }; }
+      }
     }
-    return reduceCoveredRanges(covered_range);
+    return std::nullopt;
+  };
+
+  // Row by row search for the uncovered point, for when the boundary
+  // diagonals don't give it.  Sensors are kept as a structure of arrays
+  // sorted by x, so the spans for a row come out nearly sorted by their start
+  // and an insertion sort puts them in order for a linear merge.  Each thread
+  // reuses one span buffer and interval set, pulls chunks of rows from a
+  // shared counter, and stops as soon as any thread has found a gap.
+  class RowCoverage {
+    public:
+      RowCoverage(const Report& r) {
+        std::vector<Beacon> sensors(r.begin(), r.end());
+        std::sort(sensors.begin(), sensors.end());
+        for (const auto& [sensor, radius] : sensors) {
+          xs_.push_back(sensor.first);
+          ys_.push_back(sensor.second);
+          radii_.push_back(radius);
+        }
+      }
+
+      std::optional<aoc::Point> find_gap(int64_t limit) const {
+        std::atomic<int64_t> next_row{0};
+        std::atomic<bool> found{false};
+        std::optional<aoc::Point> gap;
+        std::mutex m;
+
+        aoc::parallel_for(aoc::thread_count(), [&](size_t, size_t) {
+          Ranges spans;
+          spans.reserve(xs_.size());
+          aoc::IntervalSet covered;
+          while (!found.load(std::memory_order_relaxed)) {
+            const int64_t first = next_row.fetch_add(RowsPerChunk);
+            if (first > limit) { break; }
+            const int64_t last = std::min(limit, first + RowsPerChunk - 1);
+            for (int64_t y = first; y <= last; y++) {
+              const auto x = row_gap(y, limit, spans, covered);
+              if (x) {
+                std::lock_guard<std::mutex> l(m);
+                gap = aoc::Point{ *x, y };
+                found = true;
+                break;
+              }
+            }
+          }
+        });
+        return gap;
+      }
+
+    private:
+      static constexpr int64_t RowsPerChunk = 4096;
+
+      // The first x in [0, limit] on row y that no sensor covers
+      std::optional<int64_t> row_gap(int64_t y, int64_t limit, Ranges& spans, aoc::IntervalSet& covered) const {
+        spans.clear();
+        for (size_t i = 0; i < xs_.size(); i++) {
+          const int64_t d = radii_[i] - std::abs(y - ys_[i]);
+          if (d < 0) { continue; }
+          const aoc::IntervalSet::Interval span{ xs_[i] - d, xs_[i] + d };
+          size_t j = spans.size();
+          spans.emplace_back();
+          for ( ; j > 0 && spans[j - 1].first > span.first; j--) {
+            spans[j] = spans[j - 1];
+          }
+          spans[j] = span;
+        }
+
+        covered.clear();
+        covered.insert_sorted(spans);
+        return covered.first_gap(0, limit);
+      }
+
+      std::vector<int64_t> xs_;
+      std::vector<int64_t> ys_;
+      std::vector<int64_t> radii_;
   };
 }
 
@@ -97,68 +210,41 @@ int main(int argc, char** argv) {
   const bool inTest = argc < 2;
 
   Report r;
+  Beacons beacons;
   if (inTest) {
-    r = LoadInput(SampleInput);
+    r = LoadInput(SampleInput, beacons);
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    r = LoadInput(f, beacons);
   }
 
-  int part1 = 0;
+  int64_t part1 = 0;
   int64_t part2 = 0;
 
   {
     const int64_t row = inTest ? 10 : 2000000;
-    const auto ranges = getCoveredRanges(r, row);
+    const auto covered = getCoveredRow(r, row);
 
-    for (const auto& last : ranges) {
-      part1 += std::abs(last.second - last.first);
+    // a cell holding a beacon is not one where a beacon can't be
+    part1 = covered.length();
+    for (const auto& b : beacons) {
+      part1 -= (b.second == row && covered.contains(b.first));
     }
   }
 
-  Report r2;
-  int64_t min = INT_MAX;
-  int64_t max = INT_MIN;
-  
-  if (inTest) {
-    r2 = r;
-    min = 0;
-    max = 20;
-  } else {
-    // Reduce the set of beacons to those which are radius + 2 apart
-    // The only uncovered point in this quadrant is where the distress beacon is
-    std::vector<int64_t>ys;
-
-    for (const auto& [lpt, lradius] : r) {
-      for (const auto& [rpt, rradius] : r) {
-        if (lpt == rpt) { continue; }
-        const auto dist = aoc::manhattan(lpt, rpt);
-        if (dist == lradius + rradius + 2) {
-          DEBUG_LOG(lpt, lradius);
-          ys.emplace_back(lpt.second);
-          r2.emplace(lpt, lradius);
-        }
-      }
+  {
+    const int64_t limit = inTest ? 20 : 4000000;
+    // `scan` after the input forces the row by row search
+    const bool scan = argc > 2 && std::string_view(argv[2]) == "scan";
+    auto beacon = scan ? std::nullopt : findDistressBeacon(r, limit);
+    if (!beacon) {
+      beacon = RowCoverage(r).find_gap(limit);
     }
-    assert(ys.size() == 4);
-    std::sort(ys.begin(), ys.end());
-    max = ys[2];
-    min = ys[1];
-    max = std::min(static_cast<int64_t>(4000000), max);
-  }
-
-  for (int64_t y = min; y < max; y++) {
-    const auto ranges = getCoveredRanges(r2, y);
-    if (ranges.size() < 2) { continue; }
-
-    if (ranges[0].second < 0 || ranges[1].first > max) {
-      continue;
+    if (beacon) {
+      DEBUG_LOG(*beacon);
+      part2 = beacon->second + (beacon->first * 4000000);
     }
-    const auto x = (ranges[0].second + 1);
-    DEBUG_LOG(y, x);
-    part2 = y + (x * 4000000);
-    break;
   }
 
   aoc::print_results(part1, part2);
@@ -166,6 +252,24 @@ int main(int argc, char** argv) {
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    const auto scanned = RowCoverage(r).find_gap(20).value_or(aoc::Point{});
+    aoc::assert_result(scanned.second + (scanned.first * 4000000), SR_Part2);
+
+    // The beacon's row again, one span at a time in report order, so spans
+    // arrive unsorted and overlap or touch as they merge
+    aoc::IntervalSet row;
+    for (const auto& [sensor, radius] : r) {
+      const int64_t distance = radius - std::abs(scanned.second - sensor.second);
+      if (distance >= 0) {
+        row.insert(sensor.first - distance, sensor.first + distance);
+      }
+    }
+    aoc::assert_result(row.length(), getCoveredRow(r, scanned.second).length());
+    std::vector<aoc::IntervalSet::Interval> gaps;
+    row.gaps(0, 20, [&gaps](int64_t lo, int64_t hi) { gaps.emplace_back(lo, hi); });
+    aoc::assert_result(gaps.size(), size_t{1});
+    aoc::assert_result(gaps.front().first * 4000000 + scanned.second, SR_Part2);
   }
 
   return 0;
@@ -1,9 +1,10 @@
 #include "aoc/helpers.h"
+#include "aoc/parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <unordered_map>
 #include <vector>
-#include <map>
-#include <set>
-#include <functional>
-#include <queue>
 
 namespace {
   using Result = std::pair<int, int>;
@@ -27,154 +28,391 @@ Valve JJ has flow rate=21; tunnel leads to valve II)");
 #endif
   STRING_CONSTANT(STR_VALVES, "valves");
   STRING_CONSTANT(STR_VALVE_, "valve");
+  STRING_CONSTANT(STR_START, "AA");
+
+  // Raw input, with valve names interned to dense ids as they are first
+  // seen.  Tunnels are an adjacency matrix, and `dist` holds the minutes
+  // between every pair of valves once the input is loaded.
+  struct Tunnels {
+    std::vector<std::string> names;
+    std::vector<int64_t> flow;
+    std::vector<uint8_t> exits;
+    std::vector<uint8_t> dist;
+    size_t start{0};
+
+    size_t size() const {
+      return names.size();
+    }
+  };
 
-  // Raw input
-  struct Valve {
-    std::string name;
-    int64_t flow;
-    int64_t id;
-
-    Valve()
-      : flow(0)
-      , id(0)
-    {
+  constexpr uint8_t Unreachable = UINT8_MAX;
+
+  // All pairs shortest paths over the tunnels.  Distances saturate at
+  // Unreachable, so nothing wraps around.
+  const auto FloydWarshall = [](Tunnels& tunnels) {
+    const size_t n = tunnels.size();
+    auto& dist = tunnels.dist;
+    dist.assign(n * n, Unreachable);
+    for (size_t i = 0; i < n; i++) {
+      for (size_t j = 0; j < n; j++) {
+        if (tunnels.exits[i * n + j]) { dist[i * n + j] = 1; }
+      }
+      dist[i * n + i] = 0;
+    }
+    for (size_t k = 0; k < n; k++) {
+      for (size_t i = 0; i < n; i++) {
+        const uint8_t ik = dist[i * n + k];
+        if (ik == Unreachable) { continue; }
+        for (size_t j = 0; j < n; j++) {
+          const unsigned via = ik + dist[k * n + j];
+          if (via < dist[i * n + j]) {
+            dist[i * n + j] = via;
+          }
+        }
+      }
     }
+  };
 
-    using ValveRefList = std::vector<Valve *>;
-    using ValveCost = std::pair<Valve *, int64_t>;
+  // The working valves alone, indexed 0..n-1, with the minutes to walk
+  // between every pair and from the start
+  struct Network {
+    std::vector<int64_t> flow;
+    std::vector<uint8_t> dist;
+    std::vector<uint8_t> from_start;
 
-    std::vector<ValveCost>working;
-    ValveRefList exits;
+    size_t size() const {
+      return flow.size();
+    }
   };
 
-  using ValveCost = std::pair<Valve *, int64_t>;
-  using ValveList = std::vector<Valve>;
-  using ValveRefList = std::vector<Valve *>;
-
-  const auto compressValves = [](ValveRefList& working) {
+  const auto BuildNetwork = [](const Tunnels& tunnels) {
+    Network net;
+    const size_t all = tunnels.size();
+    std::vector<size_t> valves;
+    for (size_t v = 0; v < all; v++) {
+      if (tunnels.flow[v] > 0 && tunnels.dist[tunnels.start * all + v] != Unreachable) {
+        valves.push_back(v);
+        net.flow.push_back(tunnels.flow[v]);
+        net.from_start.push_back(tunnels.dist[tunnels.start * all + v]);
+      }
+    }
+    for (const auto i : valves) {
+      for (const auto j : valves) {
+        net.dist.push_back(tunnels.dist[i * all + j]);
+      }
+    }
+    return net;
+  };
 
-    std::map<std::pair<std::string, std::string>, int64_t> costs;
+  // Pressure released by the best route which opens exactly each set of
+  // valves within `time`, indexed by the bitmask of opened valves.
+  //
+  // Routes are walked depth first, one valve opened per step.  Each (opened
+  // mask, position) remembers the time left and release of the best route to
+  // reach it so far, and a later route which arrives with no more of either
+  // is dropped: everything it could go on to do has already been tried with
+  // at least as much released.  Routes opening the same valves in another
+  // order then mostly end where they meet.
+  class BestPerMask {
+    public:
+      BestPerMask(const Network& net, int64_t time)
+        : net_(net)
+        , n_(net.size())
+        , time_(time)
+      {
+        if (n_ > 24) {
+          throw std::runtime_error("Too many working valves");
+        }
+      }
 
-    const auto cost = [&costs](Valve* start, Valve* end) {
-      struct comparator {
-        bool operator()(const ValveCost& l, const ValveCost& r) {
-          return l.second > r.second;
+      std::vector<int64_t> run() {
+        best_.assign(size_t{1} << n_, 0);
+        seen_.assign((size_t{1} << n_) * n_, Arrival{});
+        if (time_ > 0) {
+          visit(net_.from_start.data(), 0, time_, 0);
         }
+        return best_;
+      }
+
+    private:
+      struct Arrival {
+        int32_t left{0};
+        int32_t released{0};
       };
 
-      std::pair<std::string, std::string>key{start->name, end->name};
-      const auto rit = costs.find(key);
-      if (rit != costs.end()) {
-        DEBUG_LOG(start->name, end->name, rit->second);
-        return rit->second;
+      // Open each closed valve in turn from a position whose walking
+      // distances are `dist`
+      void visit(const uint8_t* dist, size_t mask, int32_t left, int32_t released) {
+        best_[mask] = std::max<int64_t>(best_[mask], released);
+        for (size_t next = 0; next < n_; next++) {
+          const size_t opened = mask | (size_t{1} << next);
+          const int32_t t = left - dist[next] - 1;
+          if (opened == mask || t <= 0) { continue; }
+
+          const int32_t total = released + net_.flow[next] * t;
+          auto& seen = seen_[opened * n_ + next];
+          if (seen.left >= t && seen.released >= total) { continue; }
+          if (total >= seen.released) {
+            seen = Arrival{ t, total };
+          }
+          visit(&net_.dist[next * n_], opened, t, total);
+        }
       }
 
-      std::priority_queue<ValveCost,
-        std::vector<ValveCost>,
-        comparator> queue;
-
-      queue.emplace(start, 0);
-      while (!queue.empty()) {
-        auto item = queue.top(); queue.pop();
+      const Network& net_;
+      const size_t n_;
+      const int64_t time_;
+      std::vector<int64_t> best_;
+      std::vector<Arrival> seen_;
+  };
 
-        if (item.first->name == end->name) {
-          key.first = end->name;
-          key.second = start->name;
-          costs.emplace(std::move(key), item.second);
-          DEBUG_LOG(start->name, end->name, item.second);
-          return item.second;
+  // Depth first branch and bound over the network, for any number of actors
+  // sharing the time, and for networks with too many working valves for a
+  // table per opened set.  The actor with the most time left always moves
+  // next, either walking to open another valve or stopping for good.
+  //
+  // A branch is cut once it can't beat the best release found so far, even
+  // if every remaining valve were opened biggest first, each at the cheapest
+  // walk in the network.  The first levels of the search are expanded up
+  // front and the branches shared out between threads, which all prune
+  // against one best.
+  class BranchAndBound {
+    public:
+      BranchAndBound(const Network& net, int64_t time, size_t actors)
+        : n_(net.size())
+        , flow_(net.flow)
+        , dist_((n_ + 1) * (n_ + 1), 0)
+        , time_(time)
+        , actors_(actors)
+      {
+        if (n_ > 64) {
+          throw std::runtime_error("Too many working valves");
         }
-
-        for (auto conn : item.first->exits) {
-          queue.emplace(conn, item.second + 1);
+        if (!actors_) {
+          throw std::runtime_error("Need at least one actor");
         }
-      }
-      assert(false);
-      return static_cast<int64_t>(-1);
-    };
-
-    for (auto valve : working) {
-      for (auto conn : working) {
-        if (conn->name == valve->name || conn->name == "AA") {
-          continue;
+        // The start is an extra valve at index n
+        int64_t cheapest = INT64_MAX;
+        for (size_t i = 0; i <= n_; i++) {
+          for (size_t j = 0; j < n_; j++) {
+            dist_[i * (n_ + 1) + j] = i < n_ ? net.dist[i * n_ + j] : net.from_start[j];
+            if (i != j) {
+              cheapest = std::min<int64_t>(cheapest, dist_[i * (n_ + 1) + j]);
+            }
+          }
         }
-
-        valve->working.emplace_back(conn, cost(valve, conn));
+        step_ = (cheapest == INT64_MAX ? 0 : cheapest) + 1;
+        by_flow_.resize(n_);
+        std::iota(by_flow_.begin(), by_flow_.end(), 0);
+        std::sort(by_flow_.begin(), by_flow_.end(), [this](size_t a, size_t b) { return flow_[a] > flow_[b]; });
       }
-    }
-  };
 
-  struct EnqueuedValve {
-    Valve *valve;
-    int64_t time;
-    int64_t released;
-    int64_t opened;
+      int64_t run() const {
+        State root;
+        root.pos.assign(actors_, n_);
+        root.left.assign(actors_, time_);
 
-    EnqueuedValve(Valve *v, int64_t t, int64_t r, int64_t o)
-      : valve(v)
-      , time(t)
-      , released(r)
-      , opened(o)
-    { }
+        std::vector<State> branches;
+        expand(root, SplitDepth, branches);
 
-    EnqueuedValve()
-      : EnqueuedValve(nullptr, 0, 0, 0)
-    { }
+        std::atomic<int64_t> best{0};
+        aoc::parallel_for(branches.size(), [&](size_t begin, size_t end) {
+          Scratch scratch;
+          scratch.moves.resize(n_ + actors_ + 1);
+          for (size_t i = begin; i < end; i++) {
+            search(branches[i], 0, scratch, best);
+          }
+        });
+        return best.load();
+      }
 
-  };
+    private:
+      static constexpr size_t SplitDepth = 2;
 
-  const auto solve = [](Valve* start) {
-    int64_t max = 0;
+      struct State {
+        uint64_t opened{0};
+        int64_t released{0};
+        std::vector<size_t> pos;
+        std::vector<int64_t> left;
+      };
 
-    std::set<std::tuple<int64_t, int64_t, int64_t>>added;
-    std::queue<EnqueuedValve>queue;
-    
-    for (auto v : start->working) {
-      queue.emplace(v.first, 30 - v.second, 0, 0);
-    }
+      struct Move {
+        size_t valve;
+        int64_t left;
+        int64_t gain;
+      };
 
-    while (!queue.empty()) {
-      auto node = queue.front(); queue.pop();
+      // Buffers for one thread's search, reused from node to node.  Every
+      // level opens a valve or stops an actor, so the depth is bounded.
+      struct Scratch {
+        std::vector<std::vector<Move>> moves;
+        std::vector<int64_t> slot;
+      };
 
-      if (!(node.opened & node.valve->id)) {
-        node.time--;
-        node.opened |= node.valve->id;
-        node.released += node.valve->flow * node.time;
+      // The actor to move next, or actors_ if none can open anything more
+      size_t next_actor(const State& s) const {
+        const auto it = std::max_element(s.left.begin(), s.left.end());
+        return *it > step_ - 1 ? it - s.left.begin() : actors_;
+      }
+
+      // Valves actor `a` could open next, most pressure first.  Actors all
+      // start alike and take their first moves in turn, so each must pick a
+      // higher valve than the actor before it to skip the same routes with
+      // the actors swapped.
+      void moves(const State& s, size_t a, std::vector<Move>& out) const {
+        out.clear();
+        const size_t first = (a > 0 && s.pos[a] == n_) ? s.pos[a - 1] + 1 : 0;
+        for (size_t v = first; v < n_; v++) {
+          const int64_t t = s.left[a] - dist_[s.pos[a] * (n_ + 1) + v] - 1;
+          if ((s.opened & (uint64_t{1} << v)) || t <= 0) { continue; }
+          out.push_back({ v, t, flow_[v] * t });
+        }
+        std::sort(out.begin(), out.end(), [](const Move& l, const Move& r) { return l.gain > r.gain; });
       }
 
-      DEBUG_LOG(node.valve->name, node.released, max);
-      max = std::max(max, node.released);
+      // The release if the remaining valves, biggest first, were each taken
+      // by whichever actor could reach one soonest: the first at the walk to
+      // the nearest closed valve, and the rest at the cheapest walk
+      int64_t bound(const State& s, std::vector<int64_t>& slot) const {
+        slot.assign(s.left.begin(), s.left.end());
+        for (size_t a = 0; a < actors_; a++) {
+          int64_t nearest = INT64_MAX;
+          for (size_t v = 0; v < n_; v++) {
+            if (!(s.opened & (uint64_t{1} << v))) {
+              nearest = std::min(nearest, dist_[s.pos[a] * (n_ + 1) + v]);
+            }
+          }
+          slot[a] -= nearest == INT64_MAX ? slot[a] : nearest + 1;
+        }
+        int64_t total = s.released;
+        for (const auto v : by_flow_) {
+          if (s.opened & (uint64_t{1} << v)) { continue; }
+          auto& t = *std::max_element(slot.begin(), slot.end());
+          if (t <= 0) { break; }
+          total += flow_[v] * t;
+          t -= step_;
+        }
+        return total;
+      }
 
-      if (node.time < 1) {
-        continue;
+      void apply(State& s, size_t a, const Move& m) const {
+        s.opened |= uint64_t{1} << m.valve;
+        s.released += m.gain;
+        s.pos[a] = m.valve;
+        s.left[a] = m.left;
       }
 
-      for (auto v : node.valve->working) {
-        if (node.time - v.second <= 0 ||
-          (node.opened & v.first->id))
-        {
-          continue;
+      // Collect the states `depth` moves in, or sooner where a branch ends
+      void expand(const State& s, size_t depth, std::vector<State>& out) const {
+        const size_t a = next_actor(s);
+        if (!depth || a == actors_) {
+          out.push_back(s);
+          return;
+        }
+        std::vector<Move> next_moves;
+        moves(s, a, next_moves);
+        for (const auto& m : next_moves) {
+          State next(s);
+          apply(next, a, m);
+          expand(next, depth - 1, out);
         }
+        State stop(s);
+        stop.left[a] = 0;
+        expand(stop, depth - 1, out);
+      }
 
-        const auto rit = added.emplace(v.first->id, node.time, node.opened);
-        if (rit.second) {
-          DEBUG_LOG(v.first->name, node.time - v.second, node.released, node.opened);
-          queue.emplace(v.first, node.time - v.second, node.released, node.opened);
+      void search(State& s, size_t depth, Scratch& scratch, std::atomic<int64_t>& best) const {
+        int64_t seen = best.load(std::memory_order_relaxed);
+        while (s.released > seen && !best.compare_exchange_weak(seen, s.released)) { }
+        if (bound(s, scratch.slot) <= best.load(std::memory_order_relaxed)) { return; }
+
+        const size_t a = next_actor(s);
+        if (a == actors_) { return; }
+        const auto pos = s.pos[a];
+        const auto left = s.left[a];
+        const auto opened = s.opened;
+        const auto released = s.released;
+        auto& next_moves = scratch.moves[depth];
+        moves(s, a, next_moves);
+        for (const auto& m : next_moves) {
+          apply(s, a, m);
+          search(s, depth + 1, scratch, best);
+          s.pos[a] = pos;
+          s.left[a] = left;
+          s.opened = opened;
+          s.released = released;
+        }
+        // leave the rest to the other actors
+        if (actors_ > 1) {
+          s.left[a] = 0;
+          search(s, depth + 1, scratch, best);
+          s.left[a] = left;
         }
       }
-    }
 
-    assert(max);
+      const size_t n_;
+      const std::vector<int64_t> flow_;
+      std::vector<int64_t> dist_;
+      std::vector<size_t> by_flow_;
+      int64_t step_;
+      const int64_t time_;
+      const size_t actors_;
+  };
+
+  // Networks with more (opened set, position, time) states than this are
+  // searched instead.  The routes above can reach every one of them, so
+  // their cost grows by more than double per valve, while the search is cut
+  // short by its bound.  Puzzle inputs have around 15 working valves, which
+  // stay on the routes; 17 or more go to the search.
+  constexpr size_t MaxTableStates = size_t{1} << 25;
 
-    return max;
+  const auto TableStates = [](const Network& net, int64_t time) {
+    return net.size() >= 32 ? SIZE_MAX : (net.size() << net.size()) * time;
+  };
+
+  const auto Solve = [](const Network& net) {
+    Result r{0, 0};
+    if (TableStates(net, 30) > MaxTableStates) {
+      r.first = BranchAndBound(net, 30, 1).run();
+      r.second = BranchAndBound(net, 26, 2).run();
+      return r;
+    }
+
+    const auto alone = BestPerMask(net, 30).run();
+    r.first = *std::max_element(alone.begin(), alone.end());
+
+    // Spread each set's best to its supersets, so best[m] is the most any
+    // route opening only valves in m can release.  The elephant then takes
+    // the complement of whatever set we open.
+    auto best = BestPerMask(net, 26).run();
+    const size_t full = best.size() - 1;
+    for (size_t bit = 1; bit <= full; bit <<= 1) {
+      for (size_t m = 0; m <= full; m++) {
+        if (m & bit) {
+          best[m] = std::max(best[m], best[m ^ bit]);
+        }
+      }
+    }
+    for (size_t m = 0; m <= full; m++) {
+      r.second = std::max<int64_t>(r.second, best[m] + best[full ^ m]);
+    }
+    return r;
   };
 
   const auto LoadInput = [](auto f) {
     std::string_view line;
-    ValveList vl;
-
-    std::map<std::string, std::vector<std::string>> conns;
-    int64_t id = 1;
+    Tunnels tunnels;
+    std::unordered_map<std::string_view, size_t> ids;
+    std::vector<std::pair<size_t, size_t>> edges;
+
+    const auto intern = [&](std::string_view name) {
+      const auto [it, added] = ids.emplace(name, tunnels.size());
+      if (added) {
+        tunnels.names.emplace_back(name);
+        tunnels.flow.push_back(0);
+      }
+      return it->second;
+    };
 
     while (aoc::getline(f, line)) {
       std::string_view part;
@@ -185,45 +423,30 @@ Valve JJ has flow rate=21; tunnel leads to valve II)");
       assert(parts.size() >= 11);
       assert(parts[0] == STR_VALVE);
       size_t i = 1;
-      Valve v;
-      v.name = parts[i++];
-      v.id = id;
-      id <<= 1;
+      const auto v = intern(parts[i++]);
       while (i < parts.size() && !aoc::is_numeric(parts[i][0])) { i++; }
-      v.flow = aoc::stoi(parts[i++]);
+      tunnels.flow[v] = aoc::stoi(parts[i++]);
       while (i < parts.size() && parts[i] != STR_VALVES && parts[i] != STR_VALVE_) { i++; }
       i++;
       assert(i < parts.size());
-      const auto cit = conns.emplace(v.name, std::vector<std::string>());
       while (i < parts.size()) {
-        cit.first->second.emplace_back(parts[i++]);
+        edges.emplace_back(v, intern(parts[i++]));
       }
-
-      vl.emplace_back(std::move(v));
     }
 
-    ValveRefList working;
-    for (size_t i = 0; i < vl.size(); i++) {
-      auto &v = vl[i];
-      if (v.name == "AA" || v.flow > 0) {
-        working.emplace_back(&vl[i]);
-        DEBUG_LOG(v.name, v.flow);
-      }
-      auto vc = conns.at(v.name);
-      for (const auto e : vc) {
-        for (size_t j = 0; j < vl.size(); j++) {
-          if (e == vl[j].name) {
-            v.exits.emplace_back(&vl[j]);
-          }
-        }
-      }
+    const auto start = ids.find(STR_START);
+    if (start == ids.end()) {
+      throw std::runtime_error("No valve AA");
     }
+    tunnels.start = start->second;
 
-    {
-      aoc::AutoTimer compress("compress");
-      compressValves(working);
+    const size_t n = tunnels.size();
+    tunnels.exits.assign(n * n, 0);
+    for (const auto& [from, to] : edges) {
+      tunnels.exits[from * n + to] = 1;
     }
-    return vl;
+    FloydWarshall(tunnels);
+    return tunnels;
   };
 }
 
@@ -231,35 +454,40 @@ int main(int argc, char** argv) {
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
-  ValveList vl;
+  Tunnels tunnels;
   if (inTest) {
-    vl = LoadInput(SampleInput);
+    tunnels = LoadInput(SampleInput);
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    vl = LoadInput(f);
+    tunnels = LoadInput(f);
   }
 
-  Valve *start = nullptr;
-  for (size_t i = 0; i < vl.size(); i++) {
-    if (vl[i].name == "AA") {
-      start = &vl[i];
-      break;
-    }
+  const auto net = BuildNetwork(tunnels);
+
+  // Minutes and number of actors after the input, for the search
+  if (argc > 2) {
+    const int64_t time = aoc::stoi(argv[2]);
+    const size_t actors = argc > 3 ? aoc::stoi(argv[3]) : 1;
+    aoc::AutoTimer t("search");
+    std::cout << actors << " in " << time << ": " << BranchAndBound(net, time, actors).run() << std::endl;
   }
-  assert(start);
+
   int64_t part1 = 0;
+  int64_t part2 = 0;
   {
-    aoc::AutoTimer t("part1");
-    part1 = solve(start);
+    aoc::AutoTimer t("solve");
+    std::tie(part1, part2) = Solve(net);
   }
-  int part2 = 0;
 
-  aoc::print_results(part1, part2); // 1720, 2582
+  aoc::print_results(part1, part2);
 
   if (inTest) {
-    aoc::assert_result(part2, SR_Part2);
     aoc::assert_result(part1, SR_Part1);
+    aoc::assert_result(part2, SR_Part2);
+
+    aoc::assert_result(BranchAndBound(net, 30, 1).run(), SR_Part1);
+    aoc::assert_result(BranchAndBound(net, 26, 2).run(), SR_Part2);
   }
 
   return 0;
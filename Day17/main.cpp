@@ -1,7 +1,6 @@
 #include "aoc/helpers.h"
 #include <vector>
 #include <array>
-#include <set>
 #include <map>
 
 namespace {
@@ -14,33 +13,207 @@ namespace {
 
   using Pattern = std::string;
 
-  using Rock = std::set<aoc::Point>;
-  using Rocks = std::vector<Rock>;
-
-  const Rocks ROCKS = {
-    {
-      { 0, 0 }, { 1, 0 }, { 2, 0 }, {3, 0 },
-    },
-    {
-                { 1, 2 },
-      { 0, 1 }, { 1, 1 }, { 2, 1 },
-                { 1, 0 },
-    },
-    {
-                          { 2, 2 },
-                          { 2, 1 },
-      { 0, 0 }, { 1, 0 }, { 2, 0 },
-    },
-    {
-      { 0, 3 },
-      { 0, 2 },
-      { 0, 1 },
-      { 0, 0 },
-    },
-    {
-      { 0, 1 }, { 1, 1 },
-      { 0, 0 }, { 1, 0 },
-    },
+  // Each row of the chamber is a bitmask of its 7 columns, with column 0 the
+  // highest bit, so moving left is a shift left.  A rock is up to 4 rows
+  // packed into a uint32_t, lowest row in the lowest byte, already placed 2
+  // from the left wall as it appears.
+  using Rock = uint32_t;
+
+  constexpr std::array<Rock, 5> ROCKS = {
+    0x0000001e,             // ..####.
+    0x00081c08,             // ...#... / ..###.. / ...#...
+    0x0004041c,             // ....#.. / ....#.. / ..###..
+    0x10101010,             // ..#.... x 4
+    0x00001818,             // ..##... x 2
+  };
+
+  constexpr Rock LEFT_WALL = 0x40404040;
+  constexpr Rock RIGHT_WALL = 0x01010101;
+
+  // Columns deeper than this below the top are all treated as the same
+  constexpr uint8_t MaxDepth = UINT8_MAX;
+
+  // Rows start as a window this big, and only grow if the rows a rock could
+  // still reach don't fit
+  constexpr size_t InitialRows = 1 << 10;
+
+  // Only the rows a falling rock could still reach are kept, in a ring
+  // buffer: row y lives at y & mask_, for base_ <= y.  Everything below
+  // base_ is treated as solid floor.
+  //
+  // A rock cell can only move down, left or right through air, so when the
+  // window fills up the air reachable that way from above the top is
+  // flood filled a row at a time.  Rows below the lowest reachable cell can
+  // never be touched again, and the floor is raised to it.
+  class Chamber {
+    public:
+      Chamber(const Pattern& jets)
+        : jets_(jets)
+        , jet_(0)
+        , rock_(0)
+        , height_(0)
+        , base_(0)
+        , rows_(InitialRows, 0)
+        , mask_(InitialRows - 1)
+      { }
+
+      // Drop the next rock until it settles
+      void drop() {
+        Rock rock = ROCKS[rock_];
+        rock_ = (rock_ + 1) % ROCKS.size();
+        int64_t y = height_ + 3;
+        reserve(y + 4);
+
+        while (true) {
+          const auto dir = jets_[jet_];
+          jet_ = (jet_ + 1) % jets_.size();
+          const Rock pushed = dir == '<' ?
+            ((rock & LEFT_WALL) ? rock : rock << 1) :
+            ((rock & RIGHT_WALL) ? rock : rock >> 1);
+          if (!(pushed & window(y))) {
+            rock = pushed;
+          }
+          if (y == base_ || (rock & window(y - 1))) {
+            break;
+          }
+          y--;
+        }
+
+        for (int64_t i = 0; rock; i++, rock >>= 8) {
+          row(y + i) |= rock & 0xff;
+          if (rock & 0xff) {
+            height_ = std::max(height_, y + i + 1);
+          }
+        }
+      }
+
+      int64_t height() const {
+        return height_;
+      }
+
+      // Rows held in memory
+      size_t capacity() const {
+        return rows_.size();
+      }
+
+      // How far below the top each column's highest rock is, packed one
+      // byte per column, with the next rock and jet: the state which decides
+      // how the rest of the tower grows
+      std::pair<uint64_t, size_t> key() const {
+        std::array<uint8_t, 7> depth;
+        depth.fill(MaxDepth);
+        uint8_t found = 0;
+        for (int64_t y = height_ - 1; y >= base_ && height_ - y < MaxDepth && found != 0x7f; y--) {
+          for (uint8_t bits = row(y) & ~found; bits; bits &= bits - 1) {
+            depth[__builtin_ctz(bits)] = height_ - 1 - y;
+          }
+          found |= row(y);
+        }
+        uint64_t skyline = rock_;
+        for (const auto d : depth) {
+          skyline = (skyline << 8) | d;
+        }
+        return { skyline, jet_ };
+      }
+
+    private:
+      uint8_t& row(int64_t y) {
+        return rows_[y & mask_];
+      }
+
+      uint8_t row(int64_t y) const {
+        return rows_[y & mask_];
+      }
+
+      // The 4 rows starting at y, packed like a rock
+      Rock window(int64_t y) const {
+        return row(y) | (row(y + 1) << 8) | (row(y + 2) << 16) | (Rock{row(y + 3)} << 24);
+      }
+
+      // Make room for rows up to `top`, first by dropping unreachable rows
+      // and then, if that is not enough, by growing the window
+      void reserve(int64_t top) {
+        if (top - base_ <= static_cast<int64_t>(rows_.size())) { return; }
+        raise_floor();
+        while (top - base_ > static_cast<int64_t>(rows_.size())) {
+          std::vector<uint8_t> grown(rows_.size() * 2, 0);
+          const int64_t grown_mask = grown.size() - 1;
+          for (int64_t y = base_; y < height_; y++) {
+            grown[y & grown_mask] = row(y);
+          }
+          rows_.swap(grown);
+          mask_ = grown_mask;
+        }
+      }
+
+      void raise_floor() {
+        uint8_t reach = 0x7f;
+        int64_t lowest = height_;
+        for (int64_t y = height_ - 1; y >= base_ && reach; y--) {
+          const uint8_t air = ~row(y) & 0x7f;
+          reach &= air;
+          for (uint8_t spread = 0; spread != reach; ) {
+            spread = reach;
+            reach = (reach | (reach << 1) | (reach >> 1)) & air;
+          }
+          if (reach) { lowest = y; }
+        }
+        for (int64_t y = base_; y < lowest; y++) {
+          row(y) = 0;
+        }
+        base_ = lowest;
+      }
+
+      const Pattern& jets_;
+      size_t jet_;
+      size_t rock_;
+      int64_t height_;
+      // lowest row still held
+      int64_t base_;
+      std::vector<uint8_t> rows_;
+      int64_t mask_;
+  };
+
+  // Height after `n` rocks.  Once the tower comes back to a state it has
+  // been in before, it repeats from there, so the rest is scaled up from
+  // the heights recorded along the way.
+  const auto TowerHeight = [](const Pattern& p, const std::vector<int64_t>& targets) {
+    Chamber chamber(p);
+    std::map<std::pair<uint64_t, size_t>, int64_t> seen;
+    std::vector<int64_t> heights{ 0 };
+    std::vector<int64_t> results;
+
+    for (int64_t dropped = 1; ; dropped++) {
+      chamber.drop();
+      heights.push_back(chamber.height());
+      const auto [it, added] = seen.emplace(chamber.key(), dropped);
+      if (added) { continue; }
+
+      const int64_t start = it->second;
+      const int64_t length = dropped - start;
+      const int64_t growth = chamber.height() - heights[start];
+      DEBUG_LOG(start, length, growth);
+      for (const auto n : targets) {
+        if (n <= dropped) {
+          results.push_back(heights[n]);
+          continue;
+        }
+        const int64_t cycles = (n - start) / length;
+        const int64_t rest = (n - start) % length;
+        results.push_back(cycles * growth + heights[start + rest]);
+      }
+      return results;
+    }
+  };
+
+  // Height after dropping every one of `n` rocks
+  const auto Simulate = [](const Pattern& p, int64_t n) {
+    Chamber chamber(p);
+    for (int64_t i = 0; i < n; i++) {
+      chamber.drop();
+    }
+    DEBUG_LOG(chamber.capacity());
+    return chamber.height();
   };
 
   const auto LoadInput = [](auto f) {
@@ -65,123 +238,20 @@ int main(int argc, char** argv) {
   }
 
   assert(p.find_first_not_of("<>") == std::string::npos);
-  assert(ROCKS.size() == 5);
+
+  // Rock count after the input to simulate the whole way
+  if (argc > 2) {
+    aoc::AutoTimer t("simulate");
+    const int64_t n = aoc::stoi(argv[2]);
+    std::cout << n << ": " << Simulate(p, n) << std::endl;
+  }
 
   int64_t part1 = 0;
   int64_t part2 = 0;
-
-  using Cave = std::set<aoc::Point>;
-
-  int64_t height = 0;
-  size_t iteration = 0;
-
-  Cave settled;
-
-  const auto canMove = [&settled](const Rock& rock, const aoc::Point& pos, const aoc::Point& move) {
-    // each point must be clear
-    for (const auto pt : rock) {
-      const auto pt2 = pos + pt + move;
-      // Must stay in the bounds
-      if (pt2.first < 0 || pt2.first > 6 || pt2.second < 0) { return false; }
-      // Must not be settled
-      if (settled.count(pt2)) { return false; }
-    }
-    return true;
-  };
-
-  const aoc::Point LEFT{ -1, 0 };
-  const aoc::Point RIGHT{ 1, 0 };
-  const aoc::Point DOWN{ 0, -1 };
-
-  using Key = std::tuple<uint8_t, size_t, std::string>;
-  using Cache = std::map<Key, std::pair<int64_t, int64_t>>;
-
-  Cache cache;
-
-  const auto cacheKey = [](const Cave& settled, int64_t height) {
-    std::string key;
-    for (int64_t x = 0; x < 7; x++) {
-      int64_t y;
-      for (y = height; y >= 0; y--) {
-        aoc::Point pt{x, y};
-        if (settled.count(pt)) {
-          break;
-        }
-      }
-      if (!key.empty()) {
-        key += ',';
-      }
-      key.append(std::to_string(height - y));
-    }
-    return key;
-  };
-
-  int64_t dropped = 0;
-  uint8_t rock_idx = 0;
-  std::vector<int64_t>heights;
-  heights.push_back(height); // initial state
-  while (!part1 && !part2) {
-
-    const auto& rock = ROCKS[rock_idx];
-    aoc::Point rock_pos{2, height + 3};
-    bool did_settle = false;
-
-    do {
-      // push one unit by jet-stream
-      const auto dir = p[iteration];
-      iteration = (iteration + 1) % p.size();
-      const auto& move = (dir == '<') ? LEFT : RIGHT;
-
-      // pushed by jet
-      if (canMove(rock, rock_pos, move)) {
-        rock_pos += move;
-      }
-      // fall by one
-      if (canMove(rock, rock_pos, DOWN)) {
-        rock_pos += DOWN;
-      } else {
-        // settle the rock
-        for (const auto pt : rock) {
-          const auto r = pt + rock_pos;
-          settled.emplace(r);
-          height = std::max(height, r.second + 1);
-        }
-
-        did_settle = true;
-      }
-    } while (!did_settle);
-
-    heights.emplace_back(height);
-
-    dropped ++;
-    rock_idx = (rock_idx + 1) % ROCKS.size();
-
-    Key cache_key = { rock_idx, iteration, cacheKey(settled, height) };
-    DEBUG_LOG(height, dropped, (int32_t)rock_idx, iteration, std::get<2>(cache_key));
-    std::pair<int64_t, int64_t> val{ dropped, height };
-    const auto r = cache.emplace(std::move(cache_key), std::move(val));
-
-    // We've seen this pattern before, so can consult our cache
-    if (!r.second) {
-      val = r.first->second;
-
-      std::vector<int64_t> results;
-      int64_t targets[] = { 2022, 1000000000000 };
-
-      for ( int64_t n : targets) {
-        int64_t x = (n - val.first) / (dropped - val.first);
-        int64_t rx = (n - val.first) % (dropped - val.first);
-
-        DEBUG_LOG(n, x, rx, val.first, val.second, height, heights[val.first + rx]);
-
-        // scale
-        int64_t hx = (x * (height - val.second)) + (heights[val.first + rx]);
-        results.push_back(hx);
-      }
-
-      part1 = results[0];
-      part2 = results[1];
-    }
+  {
+    const auto heights = TowerHeight(p, { 2022, 1000000000000 });
+    part1 = heights[0];
+    part2 = heights[1];
   }
 
   aoc::print_results(part1, part2);
@@ -189,6 +259,7 @@ int main(int argc, char** argv) {
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+    aoc::assert_result(Simulate(p, 2022), SR_Part1);
   }
 
   return 0;
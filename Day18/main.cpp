@@ -1,6 +1,7 @@
 #include "aoc/helpers.h"
+#include <array>
+#include <unordered_map>
 #include <vector>
-#include <queue>
 
 namespace {
   using Result = std::pair<int, int>;
@@ -28,102 +29,400 @@ namespace {
     int z;
   };
 
-  constexpr Point OFFSET{2, 2, 2};
-
-  Point operator+(const Point& lhs, const Point& rhs) {
-      Point out{lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z};
-      return out;
-  }
-
   std::ostream& operator<<(std::ostream& os, const Point& p) {
       os << "{ " << p.x << ", " << p.y << ", " << p.z << " }";
       return os;
   }
-  Point& operator+=(Point& lhs, const Point& rhs) {
-      lhs.x += rhs.x;
-      lhs.y += rhs.y;
-      lhs.z += rhs.z;
-      return lhs;
-  }
 
+  using Bits = std::vector<uint64_t>;
+
+  // The droplet's bounding box, padded by one empty voxel on every side, as
+  // a flat bitset.  Each row runs along x, one bit per voxel, with rows laid
+  // out by y and then z.
+  //
+  // A face is exposed wherever a voxel differs from its neighbour, so the
+  // surface area along each axis is the popcount of the volume XORed with
+  // itself shifted one voxel along that axis.  The padding keeps every face
+  // inside the box.
+  class Voxels {
+    public:
+      Voxels(const std::vector<Point>& cubes) {
+        Point lo{ INT_MAX, INT_MAX, INT_MAX };
+        Point hi{ INT_MIN, INT_MIN, INT_MIN };
+        for (const auto& c : cubes) {
+          lo = { std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z) };
+          hi = { std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z) };
+        }
+        if (cubes.empty()) { lo = hi = { 0, 0, 0 }; }
+        origin_ = { lo.x - 1, lo.y - 1, lo.z - 1 };
+        nx_ = hi.x - lo.x + 3;
+        ny_ = hi.y - lo.y + 3;
+        nz_ = hi.z - lo.z + 3;
+        words_ = (nx_ + 63) / 64;
+        rows_ = ny_ * nz_;
+        lava_.assign(rows_ * words_, 0);
+
+        // bits of each row's last word which are inside the box
+        tail_ = nx_ % 64 ? (uint64_t{1} << (nx_ % 64)) - 1 : ~uint64_t{0};
+
+        for (const auto& c : cubes) {
+          const size_t x = c.x - origin_.x;
+          const size_t row = (c.z - origin_.z) * ny_ + (c.y - origin_.y);
+          lava_[row * words_ + x / 64] |= uint64_t{1} << (x % 64);
+        }
+      }
 
-  using Row = std::vector<bool>;
-  using Plane = std::vector<Row>;
-  using Grid = std::vector<Plane>;
+      size_t surface() const {
+        return faces(lava_);
+      }
 
-  const auto getGridRow = [](Grid &g, Point p) -> Row& {
-      if (static_cast<int>(g.size()) < p.z + 2) {
-        g.resize(p.z + 2);
+      // The surface the outside air touches: the faces of everything the
+      // air can't get to, lava and trapped pockets alike
+      size_t exterior_surface() const {
+        auto solid = outside();
+        for (size_t r = 0; r < rows_; r++) {
+          for (size_t w = 0; w < words_; w++) {
+            solid[r * words_ + w] = ~solid[r * words_ + w] & mask(w);
+          }
+        }
+        return faces(solid);
       }
-      auto& plane = g[p.z];
-      if (static_cast<int>(plane.size()) < p.y + 2) {
-        plane.resize(p.y + 2);
+
+    private:
+      uint64_t mask(size_t w) const {
+        return w + 1 == words_ ? tail_ : ~uint64_t{0};
       }
-      auto& row = plane[p.y];
-      if (static_cast<int>(row.size()) < p.x + 2) {
-        row.resize(p.x + 2);
+
+      size_t faces(const Bits& v) const {
+        size_t count = 0;
+        for (size_t r = 0; r < rows_; r++) {
+          const uint64_t* row = &v[r * words_];
+          // along x, with each word's top bit carried into the next
+          uint64_t carry = 0;
+          for (size_t w = 0; w < words_; w++) {
+            count += __builtin_popcountll(row[w] ^ ((row[w] << 1) | carry));
+            carry = row[w] >> 63;
+          }
+          count += carry;
+          // along y and z, against the next row over
+          const size_t y = r % ny_;
+          const size_t z = r / ny_;
+          for (size_t w = 0; w < words_; w++) {
+            if (y + 1 < ny_) { count += __builtin_popcountll(row[w] ^ row[w + words_]); }
+            if (z + 1 < nz_) { count += __builtin_popcountll(row[w] ^ row[w + ny_ * words_]); }
+          }
+        }
+        return count;
+      }
+
+      // Flood fill the air from the padding, a whole row of voxels at a
+      // time.  Rows are swept forwards then backwards, updating in place so
+      // the air runs as far as it can in each pass, until nothing changes.
+      Bits outside() const {
+        Bits air(rows_ * words_, 0);
+        const size_t plane = ny_ * words_;
+        air[0] = 1;
+
+        const auto spread = [&](size_t r) {
+          uint64_t* row = &air[r * words_];
+          const uint64_t* lava = &lava_[r * words_];
+          const size_t y = r % ny_;
+          const size_t z = r / ny_;
+          bool changed = false;
+          for (size_t w = 0; w < words_; w++) {
+            uint64_t v = row[w];
+            if (y > 0) { v |= row[w - words_]; }
+            if (y + 1 < ny_) { v |= row[w + words_]; }
+            if (z > 0) { v |= row[w - plane]; }
+            if (z + 1 < nz_) { v |= row[w + plane]; }
+            v &= ~lava[w] & mask(w);
+            changed |= v != row[w];
+            row[w] = v;
+          }
+          // run along the row until it stops spreading
+          for (bool again = true; again; ) {
+            again = false;
+            for (size_t w = 0; w < words_; w++) {
+              const uint64_t in = (w > 0 ? row[w - 1] >> 63 : 0) | (w + 1 < words_ ? row[w + 1] << 63 : 0);
+              const uint64_t v = (row[w] | (row[w] << 1) | (row[w] >> 1) | in) & ~lava[w] & mask(w);
+              if (v != row[w]) {
+                row[w] = v;
+                again = changed = true;
+              }
+            }
+          }
+          return changed;
+        };
+
+        for (bool changed = true; changed; ) {
+          changed = false;
+          for (size_t r = 0; r < rows_; r++) {
+            changed |= spread(r);
+          }
+          for (size_t r = rows_; r-- > 0; ) {
+            changed |= spread(r);
+          }
+        }
+        return air;
       }
-      return row;
-  };
 
-  const std::vector<Point>Dirs = {
-    { -1, 0, 0 },
-    { 1, 0, 0 },
-    { 0, -1, 0 },
-    { 0, 1, 0 },
-    { 0, 0, -1 },
-    { 0, 0, 1 },
+      Point origin_;
+      size_t nx_;
+      size_t ny_;
+      size_t nz_;
+      size_t words_;
+      size_t rows_;
+      uint64_t tail_;
+      Bits lava_;
   };
 
-  const auto getAdjacent = [](Grid &g, Point p) {
-    int count = 0;
-    for (const auto& d : Dirs) {
-      const auto c = p + d;
-      const auto& row = getGridRow(g, c);
-      count += row[c.x];
+  // Droplets whose bounding box holds more voxels than this are kept sparse
+  constexpr uint64_t MaxDenseVoxels = uint64_t{1} << 28;
+
+  const auto BoxVolume = [](const std::vector<Point>& cubes) {
+    if (cubes.empty()) { return uint64_t{0}; }
+    Point lo = cubes.front();
+    Point hi = cubes.front();
+    for (const auto& c : cubes) {
+      lo = { std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z) };
+      hi = { std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z) };
     }
-    DEBUG_LOG(p, count);
-    return count;
+    return (uint64_t(hi.x - lo.x) + 3) * (uint64_t(hi.y - lo.y) + 3) * (uint64_t(hi.z - lo.z) + 3);
   };
 
-  const auto getExternalSurfaceArea = [](Grid& g, const Point max) {
-    int area = 0;
+  // An 8x8x8 brick of voxels as 8 planes along z, each bit y * 8 + x
+  using Planes = std::array<uint64_t, 8>;
+
+  constexpr Planes Empty{};
+  constexpr Planes Full{ ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull };
+
+  constexpr uint64_t Column0 = 0x0101010101010101;
+  constexpr uint64_t Column7 = 0x8080808080808080;
+
+  // Directions as -x, +x, -y, +y, -z, +z, so d ^ 1 is the opposite way
+  constexpr std::array<Point, 6> Dirs = {{
+    { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 },
+  }};
+
+  // For every voxel of a brick, the voxel next to it in direction d, taking
+  // those past the edge from `next`, the neighbouring brick that way
+  Planes Shifted(const Planes& self, const Planes& next, size_t d) {
+    Planes out;
+    for (size_t z = 0; z < 8; z++) {
+      switch (d) {
+        case 0: out[z] = ((self[z] << 1) & ~Column0) | ((next[z] & Column7) >> 7); break;
+        case 1: out[z] = ((self[z] >> 1) & ~Column7) | ((next[z] & Column0) << 7); break;
+        case 2: out[z] = (self[z] << 8) | (next[z] >> 56); break;
+        case 3: out[z] = (self[z] >> 8) | (next[z] << 56); break;
+        case 4: out[z] = z > 0 ? self[z - 1] : next[7]; break;
+        default: out[z] = z < 7 ? self[z + 1] : next[0]; break;
+      }
+    }
+    return out;
+  }
+
+  // Sparse voxels for droplets spread too far for a dense volume.  Only
+  // bricks holding lava are stored, so any other brick is all air.
+  //
+  // An empty brick with no lava brick beyond it along some axis is outside.
+  // The other empty bricks next to lava, and those joined to them, are the
+  // pockets: crevices and cavities which may or may not be open to the
+  // outside.  The air is then flood filled a brick at a time, spreading
+  // inside each lava brick with plane shifts and passing the result on to
+  // its neighbours, so memory follows the lava and its pockets rather than
+  // the bounding box.
+  class Bricks {
+    public:
+      Bricks(const std::vector<Point>& cubes) {
+        for (const auto& c : cubes) {
+          const Point b{ c.x >> 3, c.y >> 3, c.z >> 3 };
+          const size_t bit = ((c.y & 7) << 3) | (c.x & 7);
+          bricks_[key(b)].lava[c.z & 7] |= uint64_t{1} << bit;
+          positions_.emplace(key(b), b);
+        }
+        for (const auto& [k, b] : positions_) {
+          const int32_t along[3] = { b.x, b.y, b.z };
+          const uint64_t rows[3] = { key({ 0, b.y, b.z }), key({ b.x, 0, b.z }), key({ b.x, b.y, 0 }) };
+          for (size_t axis = 0; axis < 3; axis++) {
+            const auto [it, added] = extents_[axis].emplace(rows[axis], std::make_pair(along[axis], along[axis]));
+            it->second.first = std::min(it->second.first, along[axis]);
+            it->second.second = std::max(it->second.second, along[axis]);
+          }
+        }
+        find_pockets();
+        flood();
+      }
 
-    Grid visited;
+      size_t surface() const {
+        size_t count = 0;
+        for (const auto& [k, b] : positions_) {
+          const auto& lava = bricks_.at(k).lava;
+          for (size_t d = 0; d < Dirs.size(); d++) {
+            const auto it = bricks_.find(key(step(b, d)));
+            const auto n = Shifted(lava, it == bricks_.end() ? Empty : it->second.lava, d);
+            for (size_t z = 0; z < 8; z++) {
+              count += __builtin_popcountll(lava[z] & ~n[z]);
+            }
+          }
+        }
+        return count;
+      }
 
-    std::queue<Point> next;
-    next.push(max);
-    while (!next.empty()) {
-      Point p = next.front(); next.pop();
+      size_t exterior_surface() const {
+        size_t count = 0;
+        for (const auto& [k, b] : positions_) {
+          const auto& brick = bricks_.at(k);
+          for (size_t d = 0; d < Dirs.size(); d++) {
+            const auto n = Shifted(brick.outside, outside(step(b, d)), d);
+            for (size_t z = 0; z < 8; z++) {
+              count += __builtin_popcountll(brick.lava[z] & n[z]);
+            }
+          }
+        }
+        return count;
+      }
 
-      auto& v = getGridRow(visited, p);
-      if (v[p.x]) { continue; } // alredy been here
-      v[p.x] = true;            // mark it
-      DEBUG_LOG(p, v[p.x]);
+    private:
+      struct Brick {
+        Planes lava{};
+        Planes outside{};
+      };
 
-      area += getAdjacent(g, p);
+      static constexpr int32_t Bias = 1 << 20;
 
-      for (const auto& d : Dirs) {
-        const auto c = p + d;
-        auto& r = getGridRow(g, c);
-        auto& rv = getGridRow(visited, c);
-        if (!rv[c.x] && !r[c.x] &&
-              c.x > 0 && c.y > 0 && c.z > 0 &&
-              c.x < max.x + 2 && c.y < max.y + 2 && c.z < max.z + 2) {
-          next.push(c);
+      static uint64_t key(const Point& b) {
+        if (b.x < -Bias || b.x >= Bias || b.y < -Bias || b.y >= Bias || b.z < -Bias || b.z >= Bias) {
+          throw std::runtime_error("Coordinate out of range");
         }
+        return (uint64_t(b.x + Bias) << 42) | (uint64_t(b.y + Bias) << 21) | uint64_t(b.z + Bias);
+      }
+
+      static Point step(const Point& b, size_t d) {
+        return { b.x + Dirs[d].x, b.y + Dirs[d].y, b.z + Dirs[d].z };
+      }
+
+      // No lava brick lies beyond this one along some axis
+      bool open(const Point& b) const {
+        const int32_t along[3] = { b.x, b.y, b.z };
+        const uint64_t rows[3] = { key({ 0, b.y, b.z }), key({ b.x, 0, b.z }), key({ b.x, b.y, 0 }) };
+        for (size_t axis = 0; axis < 3; axis++) {
+          const auto it = extents_[axis].find(rows[axis]);
+          if (it == extents_[axis].end() || along[axis] < it->second.first || along[axis] > it->second.second) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      // The outside air in brick b as it stands
+      const Planes& outside(const Point& b) const {
+        const auto k = key(b);
+        const auto it = bricks_.find(k);
+        if (it != bricks_.end()) { return it->second.outside; }
+        const auto pit = pockets_.find(k);
+        return (pit == pockets_.end() || pit->second) ? Full : Empty;
       }
-    }
 
-    return area;
+      void find_pockets() {
+        std::vector<Point> queue;
+        for (const auto& [k, b] : positions_) {
+          for (size_t d = 0; d < Dirs.size(); d++) {
+            queue.push_back(step(b, d));
+          }
+        }
+        while (!queue.empty()) {
+          const auto b = queue.back();
+          queue.pop_back();
+          const auto k = key(b);
+          if (bricks_.count(k) || pockets_.count(k) || open(b)) { continue; }
+          pockets_.emplace(k, false);
+          for (size_t d = 0; d < Dirs.size(); d++) {
+            queue.push_back(step(b, d));
+          }
+        }
+      }
+
+      void flood() {
+        std::vector<Point> queue;
+        // pockets beside an open brick are outside from the start
+        for (auto& [k, out] : pockets_) {
+          const Point b{ int32_t(k >> 42) - Bias, int32_t((k >> 21) & 0x1fffff) - Bias, int32_t(k & 0x1fffff) - Bias };
+          for (size_t d = 0; d < Dirs.size() && !out; d++) {
+            const auto n = step(b, d);
+            out = !bricks_.count(key(n)) && !pockets_.count(key(n));
+          }
+          if (out) { queue.push_back(b); }
+        }
+        for (const auto& [k, b] : positions_) {
+          queue.push_back(b);
+        }
+
+        while (!queue.empty()) {
+          const auto b = queue.back();
+          queue.pop_back();
+          const auto it = bricks_.find(key(b));
+          if (it == bricks_.end()) {
+            // an open pocket lets air into every brick around it
+            for (size_t d = 0; d < Dirs.size(); d++) {
+              const auto n = step(b, d);
+              const auto pit = pockets_.find(key(n));
+              if (pit != pockets_.end() && !pit->second) {
+                pit->second = true;
+              } else if (!bricks_.count(key(n))) {
+                continue;
+              }
+              queue.push_back(n);
+            }
+            continue;
+          }
+
+          auto& brick = it->second;
+          const auto before = brick.outside;
+          for (bool spreading = true; spreading; ) {
+            auto next = brick.outside;
+            for (size_t d = 0; d < Dirs.size(); d++) {
+              const auto n = Shifted(brick.outside, outside(step(b, d)), d);
+              for (size_t z = 0; z < 8; z++) {
+                next[z] |= n[z];
+              }
+            }
+            for (size_t z = 0; z < 8; z++) {
+              next[z] &= ~brick.lava[z];
+            }
+            spreading = next != brick.outside;
+            brick.outside = next;
+          }
+          if (brick.outside == before) { continue; }
+
+          for (size_t d = 0; d < Dirs.size(); d++) {
+            const auto n = step(b, d);
+            const auto pit = pockets_.find(key(n));
+            if (pit != pockets_.end()) {
+              if (pit->second) { continue; }
+              // does any outside air reach the face the pocket is against?
+              const auto face = Shifted(Empty, brick.outside, d ^ 1);
+              if (face == Empty) { continue; }
+              pit->second = true;
+            } else if (!bricks_.count(key(n))) {
+              continue;
+            }
+            queue.push_back(n);
+          }
+        }
+      }
+
+      std::unordered_map<uint64_t, Brick> bricks_;
+      std::unordered_map<uint64_t, Point> positions_;
+      // empty bricks next to lava without an open line out, and whether the
+      // outside air has reached them
+      std::unordered_map<uint64_t, bool> pockets_;
+      // per row of bricks along each axis, the first and last holding lava
+      std::unordered_map<uint64_t, std::pair<int32_t, int32_t>> extents_[3];
   };
 
   const auto LoadInput = [](auto f) {
-    Result r{0, 0};
     std::string_view line;
-
-    Grid g;
-    Point max{0, 0, 0};
+    std::vector<Point> cubes;
     while (aoc::getline(f, line)) {
       std::vector<int>parts;
       aoc::parse_as_integers(line, ",", [&parts](const auto part) {
@@ -131,23 +430,10 @@ namespace {
       });
 
       assert(parts.size() == 3);
-      Point p{ parts[0], parts[1], parts[2] };
-      p += OFFSET;
-      auto& row = getGridRow(g, p);
-
-      row[p.x] = true;
-
-      int adj = getAdjacent(g, p);
-      r.first += 6;
-      r.first -= (2 * adj);
-
-      max.x = std::max(max.x, p.x);
-      max.y = std::max(max.y, p.y);
-      max.z = std::max(max.z, p.z);
+      cubes.push_back({ parts[0], parts[1], parts[2] });
+      DEBUG_LOG(cubes.back());
     }
-
-    r.second = getExternalSurfaceArea(g, max);
-    return r;
+    return cubes;
   };
 }
 
@@ -155,25 +441,36 @@ int main(int argc, char** argv) {
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
-  Result r;
+  std::vector<Point> cubes;
   if (inTest) {
-    r = LoadInput(SampleInput);
+    cubes = LoadInput(SampleInput);
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    cubes = LoadInput(f);
   }
 
   int part1 = 0;
   int part2 = 0;
-
-  std::tie(part1, part2) = r;
+  if (BoxVolume(cubes) <= MaxDenseVoxels) {
+    const Voxels v(cubes);
+    part1 = v.surface();
+    part2 = v.exterior_surface();
+  } else {
+    const Bricks b(cubes);
+    part1 = b.surface();
+    part2 = b.exterior_surface();
+  }
 
   aoc::print_results(part1, part2);
 
   if (inTest) {
     aoc::assert_result(part1, SR_Part1);
     aoc::assert_result(part2, SR_Part2);
+
+    const Bricks b(cubes);
+    aoc::assert_result(b.surface(), size_t{SR_Part1});
+    aoc::assert_result(b.exterior_surface(), size_t{SR_Part2});
   }
 
   return 0;
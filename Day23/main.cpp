@@ -178,7 +178,7 @@ namespace {
     PointHash new_pos;
     PointHash blocked;
 
-    for (const auto e : elves.g) {
+    for (const auto& e : elves.g) {
       const Elf elf(e, elves.g);
       DEBUG_LOG(e.first, e.second, elf.idle());
       if (elf.idle()) {
@@ -1,42 +1,162 @@
 #include "aoc/helpers.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
 #include <vector>
 
 namespace {
   using MappedFileSource = aoc::MappedFileSource<char>;
+  using Windows = std::vector<size_t>;
 
-  const auto LookbackUnique = [](const auto& l) {
-    DEBUG_LOG(l);
-    std::vector<bool>char_set(255);
+  constexpr std::string_view SampleInput("mjqjpqmgbljsphdztnvjfqwrcgsmlb");
+  constexpr size_t SR_Part1 = 7;
+  constexpr size_t SR_Part2 = 19;
 
-    for (const auto c : l) {
-      if (char_set[static_cast<int>(c)]) return false;
-      char_set[static_cast<int>(c)] = 1;
+  STRING_CONSTANT(STDIN_SOURCE, "-");
+
+  // Single pass marker detector for any number of window sizes.
+  //
+  // Rather than re-checking every window, we track the start of the longest
+  // run of distinct characters ending at the current offset.  When a character
+  // repeats inside that run, the run start skips straight past the previous
+  // occurrence.  A window of size w ends in a marker exactly when the run is at
+  // least w long, so all window sizes share the same O(1) per character state.
+  class MarkerDetector {
+    public:
+      MarkerDetector(const Windows& windows)
+        : windows_(windows)
+        , offset_(0)
+        , run_start_(0)
+      {
+        std::fill(last_seen_.begin(), last_seen_.end(), 0);
+      }
+
+      // Feed one character, calling `op(window_index, offset)` for every
+      // window which has a marker ending at this character.  Offsets are
+      // 1-based counts of bytes consumed, as the puzzle reports them.
+      // Anything that is not a lowercase letter (e.g. a newline) still counts
+      // towards the offset but ends the current run, so no marker spans it.
+      template<typename Op>
+      void push(char c, Op op) {
+        offset_++;
+        if (c < 'a' || c > 'z') {
+          run_start_ = offset_;
+          return;
+        }
+
+        const auto idx = static_cast<size_t>(c - 'a');
+        // last_seen_ holds 1-based offsets, so 0 means never seen
+        run_start_ = std::max(run_start_, last_seen_[idx]);
+        last_seen_[idx] = offset_;
+
+        const auto run = offset_ - run_start_;
+        for (size_t w = 0; w < windows_.size(); w++) {
+          if (run >= windows_[w]) {
+            op(w, offset_);
+          }
+        }
+      }
+
+      size_t offset() const { return offset_; }
+
+    private:
+      Windows windows_;
+      size_t offset_;
+      size_t run_start_;
+      std::array<size_t, 26> last_seen_;
+  };
+
+  // Report the first marker for each window size, stopping once all are found
+  const auto FindFirstMarkers = [](std::string_view f, const Windows& windows) {
+    std::vector<size_t> found(windows.size(), 0);
+    size_t remaining = windows.size();
+    MarkerDetector d(windows);
+    for (size_t i = 0; remaining && i < f.size(); i++) {
+      d.push(f[i], [&](size_t w, size_t offset) {
+        if (!found[w]) {
+          found[w] = offset;
+          remaining--;
+        }
+      });
+    }
+    return found;
+  };
+
+  // Never-ending input: report every marker offset as it appears.  The
+  // descriptor is read directly, which returns whatever has arrived rather
+  // than waiting for the buffer to fill, so a slow producer sees its markers
+  // as soon as the bytes that complete them are written.
+  const auto StreamMarkers = [](int fd, const Windows& windows) {
+    MarkerDetector d(windows);
+    std::array<char, 64 * 1024> buf;
+    for (;;) {
+      const auto n = ::read(fd, buf.data(), buf.size());
+      if (n == 0) { break; }
+      if (n < 0) {
+        if (errno == EINTR) { continue; }
+        throw std::runtime_error("StreamMarkers: read failed");
+      }
+      for (ssize_t i = 0; i < n; i++) {
+        d.push(buf[i], [&](size_t w, size_t offset) {
+          std::cout << windows[w] << ": " << offset << '\n';
+        });
+      }
+      std::cout.flush();
     }
-    return true;
+  };
+
+  const auto ParseWindows = [](int argc, char** argv) {
+    Windows windows;
+    for (int i = 2; i < argc; i++) {
+      const auto w = aoc::stoi(argv[i]);
+      if (w < 1 || w > 26) {
+        throw std::runtime_error("Window size must be in [1, 26]: " + std::string(argv[i]));
+      }
+      windows.push_back(w);
+    }
+    if (windows.empty()) {
+      windows = { 4, 14 };
+    }
+    return windows;
   };
 }
 
 int main(int argc, char** argv) {
   aoc::AutoTimer t;
+  const bool inTest = argc < 2;
 
-  std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
-  std::string_view f(m->data(), m->size());
+  const auto windows = ParseWindows(argc, argv);
 
-  size_t part1 = 0;
-  size_t part2 = 0;
+  if (!inTest && argv[1] == STDIN_SOURCE) {
+    StreamMarkers(STDIN_FILENO, windows);
+    return 0;
+  }
 
-  assert(f.size() > 4);
-  for (size_t i = 0; (!part1 || !part2) && i < f.size() - 4; i++) {
-    std::string_view packet{f.data() + i, 4};
-    std::string_view message{f.data() + i, std::min(14LU, f.size() - i)};
-    if (!part1 && LookbackUnique(packet)) {
-      part1 = i + 4;
-    }
-    if (!part2 && message.size() == 14 && LookbackUnique(message)) {
-      part2 = i + 14;
+  std::vector<size_t> markers;
+  if (inTest) {
+    markers = FindFirstMarkers(SampleInput, windows);
+  } else {
+    std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
+    std::string_view f(m->data(), m->size());
+    markers = FindFirstMarkers(f, windows);
+  }
+
+  if (argc > 2) {
+    for (size_t w = 0; w < windows.size(); w++) {
+      std::cout << "Window " << windows[w] << ": " << markers[w] << std::endl;
     }
+    return 0;
   }
+
+  const size_t part1 = markers[0];
+  const size_t part2 = markers[1];
+
   aoc::print_results(part1, part2);
 
+  if (inTest) {
+    aoc::assert_result(part1, SR_Part1);
+    aoc::assert_result(part2, SR_Part2);
+  }
+
   return 0;
 }
@@ -2,9 +2,13 @@
 #include <utility>
 #include <optional>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
 
 namespace {
-  using Result = std::pair<int, int>;
+  using Result = std::pair<size_t, size_t>;
   using MappedFileSource = aoc::MappedFileSource<char>;
 
   constexpr std::string_view SampleInput(R"($ cd /
@@ -30,80 +34,118 @@ $ ls
 8033020 d.log
 5626152 d.ext
 7214296 k)");
-  constexpr int SR_Part1 = 95437;
-  constexpr int SR_Part2 = 24933642;
+  constexpr size_t SR_Part1 = 95437;
+  constexpr size_t SR_Part2 = 24933642;
 
-  class Directory {
+  // Interns directory names so each node holds a small id rather than its
+  // own std::string.  Names are stored in a deque so the map keys stay valid.
+  class NameTable {
     public:
+      using NameId = uint32_t;
 
-      Directory(std::string_view name, Directory* parent)
-        : name_(name.data(), name.size())
-        , size_(0)
-        , parent_(parent)
-      { }
+      NameId intern(std::string_view name) {
+        const auto it = ids_.find(name);
+        if (it != ids_.end()) { return it->second; }
+        const auto id = static_cast<NameId>(names_.size());
+        names_.emplace_back(name);
+        ids_.emplace(names_.back(), id);
+        return id;
+      }
 
-      Directory(std::string_view name)
-        : Directory(name, nullptr)
-      { }
+      const std::string& get_name(NameId id) const {
+        return names_[id];
+      }
+
+    private:
+      std::deque<std::string> names_;
+      std::unordered_map<std::string_view, NameId> ids_;
+  };
 
-      void add_file(size_t size) {
-        size_ += size;
+  // Directory tree stored as an index based arena.  Nodes refer to each other
+  // by index, so growing the arena never invalidates a parent link, and
+  // children are found through one hash keyed by (parent, name) rather than
+  // per-node containers, so `cd` costs the same however wide the directory.
+  //
+  // Subtree totals are kept current as files arrive: adding a file walks the
+  // ancestors once, and every directory total is mirrored in a sorted multiset
+  // so threshold queries never need to walk the tree.
+  class FileSystem {
+    public:
+      using NodeId = uint32_t;
+      static constexpr NodeId Root = 0;
+      static constexpr NodeId None = UINT32_MAX;
+
+      FileSystem() {
+        nodes_.push_back(Node{names_.intern("/"), None, 0});
+        sizes_.insert(0);
       }
 
-      Directory *add_child(Directory&& child) {
-        children_.emplace_back(std::move(child));
-        return &children_.back();
+      NodeId get_parent(NodeId d) const {
+        return nodes_[d].parent;
       }
 
-      Directory* get_parent() const {
-        return parent_;
+      const std::string& get_name(NodeId d) const {
+        return names_.get_name(nodes_[d].name);
       }
 
-      size_t get_this_size() const {
-        return size_;
+      // Find the named child of `d`, creating it on first visit
+      NodeId get_child(NodeId d, std::string_view name) {
+        const auto id = names_.intern(name);
+        const uint64_t key = (static_cast<uint64_t>(d) << 32) | id;
+        const auto [it, added] = children_.emplace(key, static_cast<NodeId>(nodes_.size()));
+        if (added) {
+          nodes_.push_back(Node{id, d, 0});
+          sizes_.insert(0);
+        }
+        return it->second;
       }
 
-      size_t get_size() const {
-        size_t t = get_this_size();
-        for (const auto& c : children_) {
-          t += c.get_size();
+      // Add a file to `d` and every ancestor total.  A file listed again by a
+      // later `ls` of the same directory is only counted once.
+      void add_file(NodeId d, std::string_view name, size_t size) {
+        const uint64_t key = (static_cast<uint64_t>(d) << 32) | names_.intern(name);
+        if (!files_.insert(key).second) { return; }
+
+        for (auto n = d; n != None; n = nodes_[n].parent) {
+          auto& total = nodes_[n].total;
+          // Re-key the existing multiset node rather than reallocating one
+          auto entry = sizes_.extract(sizes_.find(total));
+          total += size;
+          entry.value() = total;
+          sizes_.insert(std::move(entry));
         }
-        return t;
       }
 
-      const std::string& get_name() const {
-        return name_;
+      size_t get_size(NodeId d) const {
+        return nodes_[d].total;
       }
 
       size_t get_size_if_less_than(size_t limit) const {
         size_t t = 0;
-        auto s = get_size();
-        if (s <= limit) { t += s; }
-        for (const auto& c : children_) {
-          t += c.get_size_if_less_than(limit);
+        const auto end = sizes_.upper_bound(limit);
+        for (auto it = sizes_.begin(); it != end; ++it) {
+          t += *it;
         }
-        DEBUG_LOG(name_, t); 
         return t;
       }
+
       size_t get_smallest_over_limit(size_t limit) const {
-        size_t t = SIZE_MAX;
-        auto s = get_size();
-        if (s > limit) {
-          t = std::min(s, t);
-        }
-        for (const auto& c : children_) {
-          s = c.get_smallest_over_limit(limit);
-          t = std::min(s, t);
-        }
-        return t;
+        const auto it = sizes_.upper_bound(limit);
+        return it == sizes_.end() ? SIZE_MAX : *it;
       }
-    private:
 
-      std::string name_;
-      size_t size_;
+    private:
+      struct Node {
+        NameTable::NameId name;
+        NodeId parent;
+        size_t total;
+      };
 
-      Directory* parent_;
-      std::vector<Directory>children_;
+      NameTable names_;
+      std::vector<Node> nodes_;
+      std::multiset<size_t> sizes_;
+      std::unordered_map<uint64_t, NodeId> children_;
+      std::unordered_set<uint64_t> files_;
   };
 
   STRING_CONSTANT(CD_COMMAND, "$ cd ");
@@ -111,41 +153,82 @@ $ ls
   STRING_CONSTANT(DIR, "dir ");
   STRING_CONSTANT(ROOT, "/");
   STRING_CONSTANT(ELIPSES, "..");
+  STRING_CONSTANT(STDIN_SOURCE, "-");
+
+  constexpr size_t SmallDirLimit = 100000;
+  constexpr size_t DiskSize = 70000000;
+  constexpr size_t SpaceNeeded = 30000000;
+
+  // Replays a terminal transcript one line at a time, so more transcript can
+  // be appended between queries.
+  class Terminal {
+    public:
+      Terminal()
+        : pwd_(FileSystem::Root)
+      { }
+
+      void feed(std::string_view line) {
+        if (aoc::starts_with(line, CD_COMMAND)) {
+          auto dir = line.substr(CD_COMMAND.size());
+          if (dir == ROOT) {
+            pwd_ = FileSystem::Root;
+          } else if (dir == ELIPSES) {
+            pwd_ = fs_.get_parent(pwd_);
+            assert(pwd_ != FileSystem::None);
+          } else {
+            pwd_ = fs_.get_child(pwd_, dir);
+          }
+          DEBUG_LOG(fs_.get_name(pwd_));
+        }
+        else if (aoc::starts_with(line, DIR)) { return; }
+        else if (aoc::starts_with(line, LS_COMMAND)) { return; }
+        else {
+          // file
+          const auto sep = line.find(' ');
+          assert(sep != std::string_view::npos);
+          const auto s = line.substr(0, sep);
+          fs_.add_file(pwd_, line.substr(sep + 1), aoc::stoi(s));
+        }
+      }
+
+      Result query() const {
+        Result r{0, 0};
+        r.first = fs_.get_size_if_less_than(SmallDirLimit);
+        const auto used = fs_.get_size(FileSystem::Root);
+        if (used + SpaceNeeded > DiskSize) {
+          r.second = fs_.get_smallest_over_limit(used + SpaceNeeded - DiskSize);
+        }
+        return r;
+      }
+
+    private:
+      FileSystem fs_;
+      FileSystem::NodeId pwd_;
+  };
 
   const auto LoadInput = [](auto f) {
-    Result r{0, 0};
     std::string_view line;
-    Directory root("/");
-    Directory* pwd = &root;
+    Terminal term;
     while (aoc::getline(f, line)) {
-      if (aoc::starts_with(line, CD_COMMAND)) {
-        auto dir = line.substr(CD_COMMAND.size());
-        if (dir == ROOT) {
-          pwd = &root;
-        } else if (dir == ELIPSES) {
-          pwd = pwd->get_parent();
-          assert(!!pwd);
-        } else {
-          Directory d{dir, pwd};
-          pwd = pwd->add_child(std::move(d));
-        }
-        DEBUG_LOG(pwd->get_name());
-      }
-      else if (aoc::starts_with(line, DIR)) { continue; }
-      else if (aoc::starts_with(line, LS_COMMAND)) {continue; }
-      else {
-        // file
-        const auto sep = line.find(' ');
-        assert(sep != std::string_view::npos);
-        const auto s = line.substr(0, sep);
-        pwd->add_file(aoc::stoi(s));
+      term.feed(line);
+    }
+    return term.query();
+  };
+
+  // Live transcript on stdin: a blank line asks for the current answers
+  const auto StreamInput = [](std::istream& s) {
+    Terminal term;
+    std::string line;
+    while (std::getline(s, line)) {
+      if (line.empty()) {
+        const auto r = term.query();
+        aoc::print_results(r.first, r.second);
+      } else {
+        term.feed(line);
       }
     }
-    r.first = root.get_size_if_less_than(100000);
-    auto unused = 70000000 - root.get_size();
-    auto limit = 30000000 - unused;
-    r.second = root.get_smallest_over_limit(limit);
-    return r;
+    const auto r = term.query();
+    aoc::print_results(r.first, r.second);
   };
 }
 
@@ -153,6 +236,11 @@ int main(int argc, char** argv) {
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
+  if (!inTest && argv[1] == STDIN_SOURCE) {
+    StreamInput(std::cin);
+    return 0;
+  }
+
   Result r;
   if (inTest) {
     r = LoadInput(SampleInput);
@@ -162,8 +250,8 @@ int main(int argc, char** argv) {
     r = LoadInput(f);
   }
 
-  int part1 = 0;
-  int part2 = 0;
+  size_t part1 = 0;
+  size_t part2 = 0;
 
   std::tie(part1, part2) = r;
 
@@ -1,4 +1,7 @@
 #include "aoc/helpers.h"
+#include "aoc/parallel.h"
+#include <array>
+#include <mutex>
 #include <vector>
 
 namespace {
@@ -9,37 +12,45 @@ namespace {
 65332
 33549
 35390)");
-  constexpr int SR_Part1 = 21;
-  constexpr int SR_Part2 = 8;
-
-  using Row = std::vector<char>;
-  using Grid = std::vector<Row>;
+  constexpr size_t SR_Part1 = 21;
+  constexpr int64_t SR_Part2 = 8;
+
+  // Tree heights stored row-major in one contiguous block
+  struct Grid {
+    size_t width{0};
+    size_t height{0};
+    std::vector<uint8_t> cells;
+  };
 
   const auto LoadInput = [](auto f) {
     std::string_view line;
     Grid grid;
     while (aoc::getline(f, line)) {
-      grid.emplace_back();
-      auto& r = grid.back();
       for (const auto c: line) {
         assert(aoc::is_numeric(c));
-        r.push_back(c);
+        grid.cells.push_back(c - '0');
       }
-      assert(grid.size() == 1 || r.size() == grid[0].size());
+      assert(grid.height == 0 || line.size() == grid.width);
+      grid.width = line.size();
+      grid.height++;
     }
     return grid;
   };
 
+  // Rows are swept in bands on separate threads, then columns are swept in
+  // bands of neighbouring columns walked row by row, so both passes read the
+  // grid in its own row-major order without a transposed copy.
   class TreeFinder {
     public:
       TreeFinder(const Grid& grid)
-        : grid_(grid)
-        , width_(grid[0].size())
-        , height_(grid.size())
-        , max_score_(INT64_MIN)
+        : max_score_(0)
         , visible_trees_(0)
       {
-        visible_trees_ = countVisibleTrees();
+        const auto cells = grid.width * grid.height;
+        std::vector<uint8_t> visible(cells);
+        std::vector<uint32_t> score(cells);
+        sweepRows(grid, visible.data(), score.data());
+        sweepColumns(grid, visible.data(), score.data());
       }
 
       int64_t getMaxScore() const {
@@ -51,63 +62,107 @@ namespace {
       }
 
     protected:
-      size_t countVisibleTrees() {
-        size_t v = (2 * width_) + (2 * (height_ - 2));
-        for (size_t y = 1; y < height_ - 1; y++) {
-          for (size_t x = 1; x < width_ - 1; x++) {
-            int64_t s;
-            v += isTreeVisible(x, y, s);
-            max_score_ = std::max(s, max_score_);
+      // For each row, mark trees visible from either end and store the
+      // product of the left and right viewing distances, in a single pass.
+      //
+      // A monotonic stack holds the trees which still have no taller or equal
+      // tree to their right, so heights strictly fall from bottom to top and
+      // it never holds more than ten entries.  A new tree pops every shorter
+      // tree, and an equal one, as the tree which ends their view to the
+      // right; whatever is left below it ends its own view to the left.  Each
+      // tree is pushed and popped once, and those left at the end of the row
+      // see the right edge.
+      static void sweepRows(const Grid& g, uint8_t* visible, uint32_t* score) {
+        aoc::parallel_for(g.height, [&](size_t begin, size_t end) {
+          std::array<int32_t, 10> stack;
+          for (size_t y = begin; y < end; y++) {
+            const auto* row = &g.cells[y * g.width];
+            auto* vis = visible + y * g.width;
+            auto* sc = score + y * g.width;
+            const int32_t width = g.width;
+
+            size_t top = 0;
+            for (int32_t x = 0; x < width; x++) {
+              const auto h = row[x];
+              while (top && row[stack[top - 1]] < h) {
+                const auto i = stack[--top];
+                sc[i] *= x - i;
+              }
+              vis[x] = top == 0;
+              sc[x] = top ? x - stack[top - 1] : x;
+              if (top && row[stack[top - 1]] == h) {
+                const auto i = stack[--top];
+                sc[i] *= x - i;
+              }
+              stack[top++] = x;
+            }
+            while (top) {
+              const auto i = stack[--top];
+              vis[i] = 1;
+              sc[i] *= width - 1 - i;
+            }
           }
-        }
-        return v;
+        }, 64);
       }
 
-      bool isTreeVisible(size_t x, size_t y, int64_t& score) const {
-        score = 0;
-        if (x == 0 || x == width_ - 1) { return true; }
-        if (y == 0 || y == height_ - 1) { return true; }
-        const auto& row = grid_[y];
-        char height = row[x];
-        if (height == 0) { return false; }
-
-        // From left
-        bool visibleL = true;
-        int32_t scoreL = 0;
-        for (size_t i = x; visibleL && i > 0; i--) {
-          scoreL += visibleL;
-          if (row[i - 1] >= height) { visibleL = false; }
-        }
-        // from right
-        bool visibleR = true;
-        int32_t scoreR = 0;
-        for (size_t i = x + 1; visibleR && i < width_; i++) {
-          scoreR += visibleR;
-          if (row[i] >= height) { visibleR = false; }
-        }
-        // from top
-        bool visibleT = true;
-        int32_t scoreT = 0;
-        for (size_t j = y; visibleT && j > 0; j--) {
-          scoreT += visibleT;
-          if (grid_[j - 1][x] >= height ) { visibleT = false; }
-        }
-        // from bottom
-        bool visibleD = true;
-        int32_t scoreD = 0;
-        for (size_t j = y + 1; visibleD && j < height_; j++) {
-          scoreD += visibleD;
-          if (grid_[j][x] >= height ) { visibleD = false; }
-        }
-        score = scoreL * scoreR * scoreT * scoreD;
-        DEBUG_LOG(x, y, height, score, scoreL, scoreR, scoreT, scoreD);
-        return visibleL || visibleR || visibleD || visibleT;
+      // A tree on a column stack, carrying its score so far and whether it
+      // is already visible, so popping it needs nothing from rows above
+      struct Entry {
+        int64_t score;
+        int32_t y;
+        uint8_t height;
+        bool visible;
+      };
+
+      // The same stack, one per column.  A tree's view down ends when it is
+      // popped, so its score and visibility are final there and are folded
+      // straight into the totals.
+      void sweepColumns(const Grid& g, const uint8_t* visible, const uint32_t* score) {
+        std::mutex m;
+        aoc::parallel_for(g.width, [&](size_t begin, size_t end) {
+          const size_t columns = end - begin;
+          std::vector<Entry> stacks(columns * 10);
+          std::vector<uint8_t> tops(columns, 0);
+          size_t v = 0;
+          int64_t s = 0;
+          const auto finish = [&](const Entry& e, int32_t y, bool open_below) {
+            v += e.visible | open_below;
+            s = std::max(s, e.score * (y - e.y));
+          };
+
+          const int32_t height = g.height;
+          for (int32_t y = 0; y < height; y++) {
+            const auto offset = y * g.width + begin;
+            const auto* row = &g.cells[offset];
+            for (size_t c = 0; c < columns; c++) {
+              const auto h = row[c];
+              auto* stack = &stacks[c * 10];
+              auto& top = tops[c];
+              while (top && stack[top - 1].height < h) {
+                finish(stack[--top], y, false);
+              }
+              const int32_t up = top ? y - stack[top - 1].y : y;
+              const Entry e{ int64_t{score[offset + c]} * up, y, h,
+                             visible[offset + c] || top == 0 };
+              if (top && stack[top - 1].height == h) {
+                finish(stack[--top], y, false);
+              }
+              stack[top++] = e;
+            }
+          }
+          for (size_t c = 0; c < columns; c++) {
+            while (tops[c]) {
+              finish(stacks[c * 10 + --tops[c]], height - 1, true);
+            }
+          }
+
+          std::lock_guard<std::mutex> l(m);
+          visible_trees_ += v;
+          max_score_ = std::max(s, max_score_);
+        }, 64);
       }
 
     private:
-      const Grid& grid_;
-      const size_t width_;
-      const size_t height_;
       int64_t max_score_;
       int64_t visible_trees_;
   };
@@ -128,8 +183,8 @@ int main(int argc, char** argv) {
 
   const TreeFinder tf(grid);
 
-  int part1 = tf.getVisibleTrees();
-  int part2 = tf.getMaxScore();
+  const size_t part1 = tf.getVisibleTrees();
+  const int64_t part2 = tf.getMaxScore();
 
   aoc::print_results(part1, part2);
 
@@ -1,6 +1,8 @@
 #include "aoc/helpers.h"
+#include "aoc/point.h"
 #include <array>
-#include <set>
+#include <unordered_map>
+#include <vector>
 
 namespace {
   using Result = std::pair<int, int>;
@@ -17,92 +19,96 @@ R 2)");
   constexpr int SR_Part1 = 13;
   constexpr int SR_Part2 = 1;
 
-  using PointSet = std::set<aoc::Point>;
-  using Elements = std::array<aoc::Point, 10>;
+  constexpr size_t DefaultKnots = 10;
 
-  constexpr aoc::Point Up{0, 1};
-  constexpr aoc::Point Down{0, -1};
-  constexpr aoc::Point Left{-1, 0};
-  constexpr aoc::Point Right{1, 0};
+  const auto ParseKnots = [](int argc, char** argv) {
+    if (argc < 3) {
+      return DefaultKnots;
+    }
+    const auto knots = aoc::stoi(argv[2]);
+    if (knots < 2) {
+      throw std::runtime_error("Rope needs at least 2 knots: " + std::string(argv[2]));
+    }
+    return static_cast<size_t>(knots);
+  };
 
-  aoc::Point operator+(const aoc::Point& lhs, const aoc::Point& rhs) {
-    aoc::Point out{lhs.first + rhs.first, lhs.second + rhs.second};
-    return out;
-  }
+  // Set of visited cells as a sparse map of 64x64 bit tiles, so memory
+  // follows the cells visited rather than the area the rope wanders over.
+  // Consecutive steps almost always land in the same tile, so the last tile
+  // used is kept to skip the hash lookup.
+  class VisitedTiles {
+    public:
+      void mark(const aoc::point p) {
+        const uint64_t key = (uint64_t(uint32_t(p.x >> 6)) << 32) | uint32_t(p.y >> 6);
+        if (!last_ || key != last_key_) {
+          last_ = &tiles_[key];
+          last_key_ = key;
+        }
+        auto& w = (*last_)[p.y & 63];
+        const uint64_t bit = uint64_t{1} << (p.x & 63);
+        count_ += !(w & bit);
+        w |= bit;
+      }
 
-  aoc::Point& operator+=(aoc::Point& lhs, const aoc::Point& rhs) {
-    lhs.first += rhs.first;
-    lhs.second += rhs.second;
-    return lhs;
-  }
+      size_t size() const {
+        return count_;
+      }
 
-  aoc::Point operator-(const aoc::Point& lhs, const aoc::Point& rhs) {
-    aoc::Point out{lhs.first - rhs.first, lhs.second - rhs.second};
-    return out;
-  }
+    private:
+      using Tile = std::array<uint64_t, 64>;
 
-  template <typename T> int sgn(T val) {
-    return (T(0) < val) - (val < T(0));
-  }
+      std::unordered_map<uint64_t, Tile> tiles_;
+      // references into an unordered_map stay valid as it grows
+      Tile* last_{nullptr};
+      uint64_t last_key_{0};
+      size_t count_{0};
+  };
 
-  const auto Step = [](PointSet& part1, PointSet& part2, Elements& elems, const aoc::Point dir, int step) {
-    while (step) {
-      // Move the head
-      elems[0] += dir;
-      DEBUG_LOG(elems[0].first, elems[0].second);
-
-      for (size_t i = 1; i < 10; i++) {
-        const auto& prev = elems[i - 1];
-        auto& tail = elems[i];
-        const auto diff = prev - tail;
-        const auto diff_x = std::abs(diff.first);
-        const auto diff_y = std::abs(diff.second);
-        if (!diff_x || !diff_y) {
-          // need to move in one plane
-          if (diff_x > 1) {
-            tail.first += sgn(diff.first);
-          } 
-          if (diff_y > 1) {
-            tail.second += sgn(diff.second);
+  // A rope of any number of knots.  Part 1 follows the knot behind the head,
+  // part 2 follows the tail.
+  class Rope {
+    public:
+      Rope(size_t knots)
+        : knots_(knots)
+      {
+        assert(knots >= 2);
+        second_.mark(knots_[1]);
+        tail_.mark(knots_.back());
+      }
+
+      void move(const aoc::point dir, int64_t steps) {
+        for ( ; steps > 0; steps--) {
+          knots_[0] += dir;
+          size_t i = 1;
+          for ( ; i < knots_.size(); i++) {
+            const auto diff = knots_[i - 1] - knots_[i];
+            // Still touching, so this knot and every knot behind it stay put
+            if (std::abs(diff.x) <= 1 && std::abs(diff.y) <= 1) { break; }
+            knots_[i] += diff.sgn();
+            if (i == 1) { second_.mark(knots_[i]); }
           }
-        } else if (diff_x != 1 || diff_y != 1) {
-          // need to move in both planes
-          aoc::Point d{ sgn(diff.first), sgn(diff.second) };
-          tail += d;
+          if (i == knots_.size()) { tail_.mark(knots_.back()); }
         }
       }
-      if (part1.emplace(elems[1]).second) {
-        DEBUG_LOG(elems[1].first, elems[1].second);
-      }
-      part2.emplace(elems[9]);
-      step--;
-    } 
-  };
 
-  const auto MoveUp = [](PointSet& part1, PointSet& part2, Elements& elems, int64_t d) {
-    Step(part1, part2, elems, Up, d);
-  };
-
-  const auto MoveDown = [](PointSet& part1, PointSet& part2, Elements& elems, int64_t d) {
-    Step(part1, part2, elems, Down, d);
-  };
+      size_t second_visited() const {
+        return second_.size();
+      }
 
-  const auto MoveLeft = [](PointSet& part1, PointSet& part2, Elements& elems, int64_t d) {
-    Step(part1, part2, elems, Left, d);
-  };
+      size_t tail_visited() const {
+        return tail_.size();
+      }
 
-  const auto MoveRight = [](PointSet& part1, PointSet& part2, Elements& elems, int64_t d) {
-    Step(part1, part2, elems, Right, d);
+    private:
+      std::vector<aoc::point> knots_;
+      VisitedTiles second_;
+      VisitedTiles tail_;
   };
 
-  const auto LoadInput = [](auto f) {
+  const auto LoadInput = [](auto f, size_t knots) {
     Result r{0, 0};
     std::string_view line;
-    aoc::Point H{0, 0};
-    Elements elems{ H, H, H, H, H, H, H, H, H, H };
-
-    std::set<aoc::Point> part1;
-    std::set<aoc::Point> part2;
+    Rope rope(knots);
 
     while (aoc::getline(f, line)) {
       DEBUG_LOG(line);
@@ -112,24 +118,24 @@ R 2)");
       const auto d = aoc::stoi(line.substr(2));
       switch (c) {
         case 'U':
-          MoveUp(part1, part2, elems, d);
+          rope.move(aoc::point::down(), d);
           break;
         case 'D':
-          MoveDown(part1, part2, elems, d);
+          rope.move(aoc::point::up(), d);
           break;
         case 'R':
-          MoveRight(part1, part2, elems, d);
+          rope.move(aoc::point::right(), d);
           break;
         case 'L':
-          MoveLeft(part1, part2, elems, d);
+          rope.move(aoc::point::left(), d);
           break;
         default:
           assert(false);
       }
     }
 
-    r.first = part1.size();
-    r.second = part2.size();
+    r.first = rope.second_visited();
+    r.second = rope.tail_visited();
     return r;
   };
 }
@@ -138,13 +144,15 @@ int main(int argc, char** argv) {
   aoc::AutoTimer t;
   const bool inTest = argc < 2;
 
+  const size_t knots = ParseKnots(argc, argv);
+
   Result r;
   if (inTest) {
-    r = LoadInput(SampleInput);
+    r = LoadInput(SampleInput, knots);
   } else {
     std::unique_ptr<MappedFileSource>m(new MappedFileSource(argc, argv));
     std::string_view f(m->data(), m->size());
-    r = LoadInput(f);
+    r = LoadInput(f, knots);
   }
 
   int part1 = 0;
@@ -15,6 +15,7 @@
 #include <functional>
 #include <iomanip>
 #include <vector>
+#include <memory>
 
 #ifndef NDEBUG
 #define DEBUG(x) do { \
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace aoc {
+
+    // A set of integers held as sorted, disjoint, closed intervals.
+    // Intervals which overlap or touch are merged as they are inserted, so
+    // [1, 3] and [4, 6] are stored as [1, 6].
+    class IntervalSet {
+    public:
+        using Interval = std::pair<int64_t, int64_t>;
+        using const_iterator = std::vector<Interval>::const_iterator;
+
+        void clear() {
+            spans_.clear();
+        }
+
+        bool empty() const {
+            return spans_.empty();
+        }
+
+        // Number of disjoint intervals
+        size_t size() const {
+            return spans_.size();
+        }
+
+        const_iterator begin() const {
+            return spans_.begin();
+        }
+
+        const_iterator end() const {
+            return spans_.end();
+        }
+
+        // Add [lo, hi], merging with any interval it overlaps or touches
+        void insert(int64_t lo, int64_t hi) {
+            if (lo > hi) { return; }
+            // first interval which could merge: the first ending at lo - 1 or later
+            auto first = std::lower_bound(spans_.begin(), spans_.end(), lo,
+                [](const Interval& s, int64_t v) { return s.second < v - 1; });
+            auto last = first;
+            while (last != spans_.end() && last->first <= hi + 1) {
+                lo = std::min(lo, last->first);
+                hi = std::max(hi, last->second);
+                ++last;
+            }
+            if (first == last) {
+                spans_.insert(first, Interval{ lo, hi });
+                return;
+            }
+            *first = Interval{ lo, hi };
+            spans_.erase(first + 1, last);
+        }
+
+        // Add a batch of intervals already sorted by their start.  The batch
+        // is merged with the current contents in a single linear pass, reusing
+        // the set's storage.
+        void insert_sorted(const std::vector<Interval>& sorted) {
+            if (sorted.empty()) { return; }
+            assert(std::is_sorted(sorted.begin(), sorted.end(),
+                [](const Interval& a, const Interval& b) { return a.first < b.first; }));
+
+            merged_.clear();
+            const auto append = [this](const Interval& s) {
+                if (s.first > s.second) { return; }
+                if (!merged_.empty() && s.first <= merged_.back().second + 1) {
+                    merged_.back().second = std::max(merged_.back().second, s.second);
+                } else {
+                    merged_.push_back(s);
+                }
+            };
+
+            auto a = spans_.begin();
+            auto b = sorted.begin();
+            while (a != spans_.end() || b != sorted.end()) {
+                if (b == sorted.end() || (a != spans_.end() && a->first <= b->first)) {
+                    append(*a++);
+                } else {
+                    append(*b++);
+                }
+            }
+            spans_.swap(merged_);
+        }
+
+        bool contains(int64_t v) const {
+            const auto it = std::lower_bound(spans_.begin(), spans_.end(), v,
+                [](const Interval& s, int64_t x) { return s.second < x; });
+            return it != spans_.end() && it->first <= v;
+        }
+
+        // Total count of integers in the set
+        int64_t length() const {
+            int64_t total = 0;
+            for (const auto& [lo, hi] : spans_) {
+                total += hi - lo + 1;
+            }
+            return total;
+        }
+
+        // Call op(lo, hi) for each run of [from, to] not in the set, in order
+        template<typename Op>
+        void gaps(int64_t from, int64_t to, Op op) const {
+            int64_t next = from;
+            auto it = std::lower_bound(spans_.begin(), spans_.end(), from,
+                [](const Interval& s, int64_t x) { return s.second < x; });
+            for ( ; it != spans_.end() && next <= to; ++it) {
+                if (it->first > next) {
+                    op(next, std::min(to, it->first - 1));
+                }
+                next = std::max(next, it->second + 1);
+            }
+            if (next <= to) {
+                op(next, to);
+            }
+        }
+
+        // The lowest integer in [from, to] not in the set
+        std::optional<int64_t> first_gap(int64_t from, int64_t to) const {
+            const auto it = std::lower_bound(spans_.begin(), spans_.end(), from,
+                [](const Interval& s, int64_t x) { return s.second < x; });
+            const int64_t v = (it != spans_.end() && it->first <= from) ? it->second + 1 : from;
+            if (v > to) { return std::nullopt; }
+            return v;
+        }
+
+    private:
+        std::vector<Interval> spans_;
+        // scratch for insert_sorted, kept to reuse its capacity
+        std::vector<Interval> merged_;
+    };
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace aoc {
+
+    size_t thread_count() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Split [0, n) into contiguous bands and call op(begin, end) for each band
+    // on its own thread.  Ranges with fewer than `min_band` items per thread
+    // are given fewer threads, down to running inline on the caller.
+    template<typename Op>
+    void parallel_for(size_t n, Op op, size_t min_band = 1) {
+        const size_t threads = std::min(thread_count(), std::max<size_t>(1, n / std::max<size_t>(1, min_band)));
+        if (threads <= 1) {
+            op(size_t{0}, n);
+            return;
+        }
+
+        const size_t band = (n + threads - 1) / threads;
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for (size_t b = band; b < n; b += band) {
+            const size_t e = std::min(n, b + band);
+            workers.emplace_back([&op, b, e]() { op(b, e); });
+        }
+        op(size_t{0}, std::min(n, band));
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+}